@@ -0,0 +1,7 @@
+#ifndef INHOUSE_AFFINEACCESS_H
+#define INHOUSE_AFFINEACCESS_H
+
+// The affine access analysis is shared with ProductionRun, lib/Common/CMakeLists.txt builds its source
+#include "../../../ProductionRun/include/Common/AffineAccess.h"
+
+#endif //INHOUSE_AFFINEACCESS_H
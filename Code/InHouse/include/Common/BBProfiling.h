@@ -1,6 +1,7 @@
 #ifndef INHOUSE_BBPROFILING_H
 #define INHOUSE_BBPROFILING_H
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <stack>
@@ -40,7 +41,8 @@ public:
 
     BBProfilingNode(BasicBlock *BB): _basicBlock(BB), _color(WHITE)
     {
-        static unsigned nextUID = 0;
+        // graphs of different funcs are built in parallel by InHouseHookPass
+        static std::atomic<unsigned> nextUID(0);
         _uid = nextUID ++;
     }
 
@@ -152,7 +154,7 @@ public:
     void splitLoopBlock(Loop * pLoop);
     void splitGivenBlock(set<BasicBlock *> & setBlocks);
     void calculateSpanningTree();
-    BBProfilingEdge * addQueryChord();
+    void addQueryChords();
 
     unsigned long instrumentLocalCounterUpdate(AllocaInst * numLocalCounter);
 
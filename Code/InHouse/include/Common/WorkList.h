@@ -0,0 +1,7 @@
+#ifndef INHOUSE_WORKLIST_H
+#define INHOUSE_WORKLIST_H
+
+// The worklists are shared with ProductionRun
+#include "../../../ProductionRun/include/Common/WorkList.h"
+
+#endif //INHOUSE_WORKLIST_H
@@ -2,6 +2,8 @@
  * Make function inline.
  * When lib-inline 1, inline func `aprof_query_insert_page_table` in runtime lib;
  * otherwise, inline instrumented hooks, e.g. `aprof_read`, `aprof_write`, etc.
+ * A func larger than hook-inline-threshold insts first has its slow path outlined into a cold func,
+ * then it is inlined at every call site it fits, in callers of any size.
  */
 
 #ifndef INHOUSE_FUNCINLINEPASS_H
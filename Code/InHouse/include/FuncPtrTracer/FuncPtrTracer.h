@@ -1,9 +1,14 @@
 /**
  * Trace function pointer.
  * Output: /dev/shm/func_ptr_tracer.log
- * Format:
- * |long     |unsigned int          |unsigned int|
- * |thread_id|CallInst/InvokeInst ID|Function ID |
+ * Format: the resolved call edges, each logged once by runtime/FuncPtrHooks,
+ * in 64KB segments each written by one thread
+ * |long     |unsigned long|
+ * |thread_id|reserved     |
+ * followed by 8-byte edges, until Function ID 0:
+ * |unsigned int          |unsigned int|
+ * |CallInst/InvokeInst ID|Function ID |
+ * FuncPtrParser prints them as the indirect call file: "inst_id func_id" per line.
  * Context: After applying IDAssigner
  */
 
@@ -1,7 +1,10 @@
 #ifndef INHOUSE_INHOUSEHOOKPASS_H
 #define INHOUSE_INHOUSEHOOKPASS_H
 
+#include <map>
+#include <memory>
 #include <set>
+#include <utility>
 #include <vector>
 
 #include "llvm/Pass.h"
@@ -11,10 +14,28 @@
 #include "llvm/Transforms/Utils/ValueMapper.h"
 
 #include "Common/MonitorRWInsts.h"
+#include "Common/WorkList.h"
+
+class BBProfilingGraph;
 
 namespace inhouse_hook_pass
 {
 
+// Results of the analysis phase of one func: computed in parallel across funcs, the IR is only read
+struct FuncAnalysis
+{
+    common::MonitoredRWInsts MI;
+    llvm::Instruction *FuncEntryInst = nullptr;                      // call_before loc
+    std::map<llvm::BasicBlock *, llvm::Instruction *> mapBBTermInst; // cost loc
+    std::set<llvm::Instruction *> setFuncExitInst;                   // return loc
+    bool bHasCall = false;
+    // loads/stores with the dominating loads/stores on the same object and no call in between, redundant if one
+    // covers and must-aliases them (sizes and AA are queried in the instrumentation phase)
+    std::vector<std::pair<llvm::Instruction *, std::vector<llvm::Instruction *>>> vecRedundantCandidates;
+    // spanning tree and chord increments of the cost counter, nullptr with bNoOptCost
+    std::unique_ptr<BBProfilingGraph> pGraph;
+};
+
 struct InHouseHookPass : public llvm::ModulePass
 {
 
@@ -46,10 +67,13 @@ struct InHouseHookPass : public llvm::ModulePass
                                     std::map<llvm::BasicBlock *, llvm::Instruction *> &mapBBEntryInst,
                                     std::set<llvm::Instruction *> &setFuncExitInst);
 
+    // analysis phase (thread safe once the struct types are sized, does not change the IR, does not print)
+    static void AnalyzeFunc(llvm::Function *F, FuncAnalysis &FA);
+
     // instrument
-    void InstrumentEntryFunc(llvm::Function *EntryFunc);
+    void InstrumentEntryFunc(llvm::Function *EntryFunc, FuncAnalysis &FA);
 
-    void InstrumentFunc(llvm::Function *F);
+    void InstrumentFunc(llvm::Function *F, FuncAnalysis &FA);
 
     void InstrumentInit(llvm::Instruction *InsertBefore);
 
@@ -59,7 +83,17 @@ struct InHouseHookPass : public llvm::ModulePass
 
     void InstrumentParams(llvm::Function *F, llvm::AllocaInst *BBAllocInst, llvm::Instruction *InsertBefore);
 
-    void InstrumentCostAdd(llvm::AllocaInst *BBAllocInst, std::map<llvm::BasicBlock *, llvm::Instruction *> &mapBBEntryInst);
+    void InstrumentCostAdd(llvm::AllocaInst *BBAllocInst, std::map<llvm::BasicBlock *, llvm::Instruction *> &mapBBEntryInst,
+                           BBProfilingGraph *bbGraph);
+
+    // promote the cost counter to SSA registers once it is instrumented
+    void PromoteCost(llvm::AllocaInst *BBAllocInst);
+
+    // replace the hooks of affine accesses in innermost loops by range hooks at the loop exits
+    void InstrumentAffineLoops(llvm::Function *F, common::MonitoredRWInsts &MI);
+
+    void InstrumentRange(llvm::Value *pStart, int Stride, unsigned ElemSize, llvm::Value *pTripCount, bool isStore,
+                         llvm::Instruction *InsertBefore);
 
     void InstrumentRW(common::MonitoredRWInsts &MI);
 
@@ -67,6 +101,11 @@ struct InHouseHookPass : public llvm::ModulePass
 
     void InstrumentFinal(std::set<llvm::Instruction *> &setFuncExitInst);
 
+    // fold the cost of a leaf func without monitored accesses into its caller, no frame
+    void InstrumentLeafFunc(llvm::Instruction *FuncEntryInst,
+                            std::map<llvm::BasicBlock *, llvm::Instruction *> &mapBBTermInst,
+                            std::set<llvm::Instruction *> &setFuncExitInst, BBProfilingGraph *bbGraph);
+
     void InstrumentLoad(llvm::LoadInst *pLoad, llvm::Instruction *InsertBefore);
 
     void InstrumentStore(llvm::StoreInst *pStore, llvm::Instruction *InsertBefore);
@@ -81,8 +120,7 @@ struct InHouseHookPass : public llvm::ModulePass
 
     void InstrumentOstream(llvm::Instruction *pCall, llvm::Instruction *InsertBefore);
 
-    void FindDirectCallees(const std::set<llvm::BasicBlock *> &setBB, std::vector<llvm::Function *> &vecWorkList,
-                           std::set<llvm::Function *> &setToDo,
+    void FindDirectCallees(const std::set<llvm::BasicBlock *> &setBB, OrdWorkList<llvm::Function *> &WorkList,
                            std::map<llvm::Function *, std::set<llvm::Instruction *>> &funcCallSiteMapping);
 
     void FindCalleesInDepth(const std::set<llvm::BasicBlock *> &setBB, std::set<llvm::Function *> &setToDo,
@@ -115,12 +153,18 @@ private:
     llvm::Function *aprof_read;
     // void aprof_increment_rms(unsigned long length);
     llvm::Function *aprof_increment_rms;
+    // void aprof_increment_cost(unsigned long numCost);
+    llvm::Function *aprof_increment_cost;
     // void aprof_call_before(unsigned funcId);
     llvm::Function *aprof_call_before;
     // void aprof_return(unsigned long numCost);
     llvm::Function *aprof_return;
     // void aprof_final();
     llvm::Function *aprof_final;
+    // void aprof_read_range(unsigned long start_addr, long stride, unsigned long length, unsigned long num);
+    llvm::Function *aprof_read_range;
+    // void aprof_write_range(unsigned long start_addr, long stride, unsigned long length, unsigned long num);
+    llvm::Function *aprof_write_range;
 };
 } // namespace inhouse_hook_pass
 
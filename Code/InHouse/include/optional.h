@@ -0,0 +1,7 @@
+#ifndef INHOUSE_OPTIONAL_H
+#define INHOUSE_OPTIONAL_H
+
+// Shared with ProductionRun, included by Common/WorkList.h
+#include "../../ProductionRun/include/optional.h"
+
+#endif //INHOUSE_OPTIONAL_H
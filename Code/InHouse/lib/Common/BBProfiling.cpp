@@ -17,35 +17,6 @@ using namespace std;
 unsigned long numTotalBB;
 // unsigned long numTotalInst;
 
-void getExitBlock(Function *pFunc, vector<BasicBlock *> &exitBlocks) {
-    exitBlocks.clear();
-
-    for (Function::iterator itBB = pFunc->begin(); itBB != pFunc->end(); itBB++) {
-        BasicBlock *BB = &*itBB;
-
-        if (isa<ReturnInst>(BB->getTerminator())) {
-            exitBlocks.push_back(BB);
-        }
-    }
-
-    assert(exitBlocks.size() == 1);
-}
-
-/*
-int getExitBlockSize(Function *pFunc) {
-    int ExistBBSize = 0;
-
-    for (Function::iterator itBB = pFunc->begin(); itBB != pFunc->end(); itBB++) {
-        BasicBlock *BB = &*itBB;
-
-        if (isa<ReturnInst>(BB->getTerminator())) {
-            ExistBBSize++;
-        }
-    }
-    return ExistBBSize;
-}
-*/
-
 BasicBlock *BBProfilingNode::getBlock() {
     return _basicBlock;
 }
@@ -585,34 +556,38 @@ int BBProfilingGraph::calculateChordIncrementsDir(BBProfilingEdge *e, BBProfilin
     return -1;
 }
 
-BBProfilingEdge *BBProfilingGraph::addQueryChord() {
-    vector<BasicBlock *> vecExitBlocks;
-    getExitBlock(&_function, vecExitBlocks);
-    
-    BBProfilingNode *pExit = _inGraphMapping[vecExitBlocks[0]];
-    if (!pExit) {
-        return NULL;
-    }
-
-    BBProfilingNode *pNewExit = (*(pExit->succBegin()))->getTarget();
+void BBProfilingGraph::addQueryChords() {
+    // Every block leaving the function (return, unreachable, resume) reaches the virtual exit node.
+    // A query chord from each of them back to the root closes one cycle per exit, its increment
+    // completes the cost of the paths ending at that exit.
+    BBPFEdgeVector vecExitEdges(getExit()->predBegin(), getExit()->predEnd());
 
-    BBProfilingEdge *pQueryEdge = addEdge(pNewExit, getRoot(), 0);
-    pQueryEdge->setType(BBProfilingEdge::QUERY_PHONY);
-
-    _chords.push_back(pQueryEdge);
+    for (BBPFEdgeIterator itEdge = vecExitEdges.begin(); itEdge != vecExitEdges.end(); itEdge++) {
+        BBProfilingEdge *pQueryEdge = addEdge((*itEdge)->getSource(), getRoot(), 0);
+        pQueryEdge->setType(BBProfilingEdge::QUERY_PHONY);
+        _chords.push_back(pQueryEdge);
+    }
+}
 
-    return pQueryEdge;
+static void addLocalCounter(AllocaInst *numLocalCounter, long inc, Instruction *InsertBefore) {
+    LoadInst *pLoadLocalCost = new LoadInst(numLocalCounter, "", false, InsertBefore);
+    pLoadLocalCost->setAlignment(8);
+    BinaryOperator *pAdd = BinaryOperator::Create(Instruction::Add, pLoadLocalCost, ConstantInt::get(
+            IntegerType::get(InsertBefore->getContext(), 64), inc), "add", InsertBefore);
+    StoreInst *pStore = new StoreInst(pAdd, numLocalCounter, false, InsertBefore);
+    pStore->setAlignment(8);
 }
 
 unsigned long BBProfilingGraph::instrumentLocalCounterUpdate(AllocaInst *numLocalCounter) {
-    
-    vector<BasicBlock *> vecExitBlocks;
-    getExitBlock(&_function, vecExitBlocks);
-    
-    BasicBlock *pExitBlock = vecExitBlocks[0];
+
+    // Increments executed in an exit block are merged into one update at its start,
+    // ahead of the instructions reading the counter (aprof_return before a return or an exit call)
+    map<BasicBlock *, long> mapExitUpdates;
+    for (BBPFEdgeIterator itEdge = getExit()->predBegin(); itEdge != getExit()->predEnd(); itEdge++) {
+        mapExitUpdates[(*itEdge)->getSource()->getBlock()] = 0;
+    }
 
     long numTotalInst = 0;
-    long numExitUpdates = 0;
 
     for (BBPFEdgeIterator itEdge = _chords.begin(); itEdge != _chords.end(); itEdge++) {
         BBProfilingEdge *pEdge = *itEdge;
@@ -621,31 +596,24 @@ unsigned long BBProfilingGraph::instrumentLocalCounterUpdate(AllocaInst *numLoca
             continue;
         }
 
-        if (pEdge->getType() == BBProfilingEdge::BB_PHONY) {
-            if (pEdge->getTarget()->getBlock() == pExitBlock) {
-                numExitUpdates += pEdge->getIncrement();
-            } else {
-                BasicBlock *pBlock = pEdge->getTarget()->getBlock();
-                Instruction *pTerm = pBlock->getTerminator();
-
-                LoadInst *pLoadLocalCost = new LoadInst(numLocalCounter, "", false, pTerm);
-                pLoadLocalCost->setAlignment(8);
-                BinaryOperator *pAdd = BinaryOperator::Create(Instruction::Add, pLoadLocalCost, ConstantInt::get(
-                        IntegerType::get(_function.getParent()->getContext(), 64), pEdge->getIncrement()), "add",
-                                                              pTerm);
-                StoreInst *pStore = new StoreInst(pAdd, numLocalCounter, false, pTerm);
-                pStore->setAlignment(8);
-                numTotalInst++;
-            }
-        } else if (pEdge->getType() == BBProfilingEdge::NORMAL) {
-            BasicBlock *pBlock = NULL;
+        BasicBlock *pBlock = NULL;
 
+        if (pEdge->getType() == BBProfilingEdge::QUERY_PHONY) {
+            pBlock = pEdge->getSource()->getBlock();
+        } else if (pEdge->getType() == BBProfilingEdge::BB_PHONY) {
+            pBlock = pEdge->getTarget()->getBlock();
+        } else if (pEdge->getType() == BBProfilingEdge::NORMAL) {
             BBProfilingNode *sourceNode = pEdge->getSource();
             BBProfilingNode *targetNode = pEdge->getTarget();
 
             BasicBlock *sourceBlock = sourceNode->getBlock();
             BasicBlock *targetBlock = targetNode->getBlock();
 
+            // Edges to and from the virtual exit node are never executed
+            if (sourceBlock == NULL || targetBlock == NULL) {
+                continue;
+            }
+
             if (sourceNode->getNumberSuccEdges() == 1) {
                 pBlock = sourceBlock;
             } else if (targetNode->getNumberPredEdges() == 1) {
@@ -659,36 +627,26 @@ unsigned long BBProfilingGraph::instrumentLocalCounterUpdate(AllocaInst *numLoca
                 } else {
                     assert(false);
                 }
-
             }
+        } else {
+            continue;
+        }
 
-            Instruction *pTerm = pBlock->getTerminator();
-
-            LoadInst *pLoadLocalCost = new LoadInst(numLocalCounter, "", false, pTerm);
-            pLoadLocalCost->setAlignment(8);
-            BinaryOperator *pAdd = BinaryOperator::Create(Instruction::Add, pLoadLocalCost, ConstantInt::get(
-                    IntegerType::get(_function.getParent()->getContext(), 64), numExitUpdates), "add", pTerm);
-            StoreInst *pStore = new StoreInst(pAdd, numLocalCounter, false, pTerm);
-            pStore->setAlignment(8);
+        map<BasicBlock *, long>::iterator itExit = mapExitUpdates.find(pBlock);
+        if (itExit != mapExitUpdates.end()) {
+            itExit->second += pEdge->getIncrement();
+        } else {
+            addLocalCounter(numLocalCounter, pEdge->getIncrement(), pBlock->getTerminator());
             numTotalInst++;
-        } else if (pEdge->getType() == BBProfilingEdge::QUERY_PHONY) {
-            numExitUpdates += pEdge->getIncrement();
         }
-
     }
 
-
-    if (numExitUpdates != 0) {
-        TerminatorInst *pTerm = pExitBlock->getTerminator();
-
-        LoadInst *pLoadLocalCost = new LoadInst(numLocalCounter, "", false, pTerm);
-        pLoadLocalCost->setAlignment(8);
-        BinaryOperator *pAdd = BinaryOperator::Create(Instruction::Add, pLoadLocalCost, ConstantInt::get(
-                IntegerType::get(_function.getParent()->getContext(), 64), numExitUpdates), "add", pTerm);
-        StoreInst *pStore = new StoreInst(pAdd, numLocalCounter, false, pTerm);
-        pStore->setAlignment(8);
-        numTotalInst++;
+    for (map<BasicBlock *, long>::iterator itExit = mapExitUpdates.begin(); itExit != mapExitUpdates.end(); itExit++) {
+        if (itExit->second != 0) {
+            addLocalCounter(numLocalCounter, itExit->second, &*itExit->first->getFirstInsertionPt());
+            numTotalInst++;
+        }
     }
 
     return numTotalInst;
-}
\ No newline at end of file
+}
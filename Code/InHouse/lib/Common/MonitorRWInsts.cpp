@@ -74,14 +74,8 @@ namespace common {
         Value *Op = pLoad->getOperand(0);
         Type *Ty = Op->getType();
         Type *Ty1 = Ty->getContainedType(0);
-        if (!Ty1) {
-            errs() << "Load Type NULL\n";
-            pLoad->dump();
-            return false;
-        }
-        if (!Ty1->isSized()) {
-            errs() << "Load Type not sized\n";
-            pLoad->dump();
+        // no diagnostic: InHouseHookPass calls this from several threads
+        if (!Ty1 || !Ty1->isSized()) {
             return false;
         }
         while (Ty1 && isa<PointerType>(Ty1)) {
@@ -99,14 +93,8 @@ namespace common {
         Value *Op = pStore->getOperand(1);
         Type *Ty = Op->getType();
         Type *Ty1 = Ty->getContainedType(0);
-        if (!Ty1) {
-            errs() << "Store Type NULL\n";
-            pStore->dump();
-            return false;
-        }
-        if (!Ty1->isSized()) {
-            errs() << "Store Type not sized\n";
-            pStore->dump();
+        // no diagnostic: InHouseHookPass calls this from several threads
+        if (!Ty1 || !Ty1->isSized()) {
             return false;
         }
         while (Ty1 && isa<PointerType>(Ty1)) {
@@ -1,13 +1,20 @@
 #include "FuncInlinePass/FuncInlinePass.h"
 
+#include <map>
 #include <set>
 
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/CallSite.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Support/raw_os_ostream.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/CodeExtractor.h"
 
 using namespace llvm;
 
@@ -17,17 +24,128 @@ namespace func_inline_pass {
                                   cl::desc("Inline Runtime Lib"),
                                   cl::init(1));
 
-    int MAX_BB_SIZE = 100;
+    static cl::opt<unsigned> inlineThreshold("hook-inline-threshold",
+                                             cl::desc("Max # of Insts of an Inlined Func (after Outlining Slow Path)"),
+                                             cl::init(80));
 
-    static int getBBNum(Function &F) {
+    static cl::opt<unsigned> coldPercent("hook-cold-percent",
+                                         cl::desc("Max Probability (%) of the Branch Entering an Outlined Slow Path"),
+                                         cl::init(40));
 
-        int num = 0;
+    static unsigned getInstNum(Function &F) {
+
+        unsigned num = 0;
         for (BasicBlock &B : F) {
-            ++num;
+            for (Instruction &I : B) {
+                if (!isa<DbgInfoIntrinsic>(&I)) {
+                    ++num;
+                }
+            }
+        }
+        return num;
+    }
+
+    static unsigned getInstNum(const SmallVectorImpl<BasicBlock *> &vecBB) {
+
+        unsigned num = 0;
+        for (BasicBlock *B : vecBB) {
+            for (Instruction &I : *B) {
+                if (!isa<DbgInfoIntrinsic>(&I)) {
+                    ++num;
+                }
+            }
         }
         return num;
     }
 
+    /*
+     * Collect the blocks dominated by Header, except returning blocks (they stay in F).
+     * Return false if the region loops back to a block outside it:
+     * the region would be a loop body, i.e. the fast path itself.
+     */
+    static bool getColdRegion(BasicBlock *Header, DominatorTree &DT, SmallVectorImpl<BasicBlock *> &vecRegion) {
+
+        SmallVector<BasicBlock *, 16> vecDominated;
+        DT.getDescendants(Header, vecDominated);
+        for (BasicBlock *B : vecDominated) {
+            if (!isa<ReturnInst>(B->getTerminator())) {
+                vecRegion.push_back(B);
+            }
+        }
+        std::set<BasicBlock *> setRegion(vecRegion.begin(), vecRegion.end());
+        for (BasicBlock *B : vecRegion) {
+            for (BasicBlock *Succ : successors(B)) {
+                if (setRegion.find(Succ) == setRegion.end() && DT.dominates(Succ, B)) {
+                    return false;
+                }
+            }
+        }
+        return !vecRegion.empty();
+    }
+
+    /*
+     * Split F into a fast path that stays in F and a slow path outlined into a cold, noinline function:
+     * the least likely single-entry region whose removal brings F under the inline threshold,
+     * e.g. the page table walk and allocation of aprof_query_insert_page_table behind the same-page check.
+     * The branch into the region must be taken at most hook-cold-percent of the time,
+     * as estimated by BranchProbabilityInfo from branch weights (__builtin_expect) or static heuristics.
+     */
+    static bool outlineSlowPath(Function &F) {
+
+        unsigned numInst = getInstNum(F);
+        if (numInst <= inlineThreshold) {
+            return true;
+        }
+
+        DominatorTree DT(F);
+        LoopInfo LI(DT);
+        BranchProbabilityInfo BPI(F, LI);
+        BranchProbability ColdProb(coldPercent, 100);
+        SmallVector<BasicBlock *, 16> vecBest;
+        unsigned numBest = 0;
+        BranchProbability BestProb = BranchProbability::getOne();
+        for (BasicBlock &B : F) {
+            BasicBlock *Pred = B.getSinglePredecessor();
+            if (&B == &F.getEntryBlock() || !Pred) {
+                continue;
+            }
+            BranchProbability Prob = BPI.getEdgeProbability(Pred, &B);
+            if (Prob > ColdProb || Prob > BestProb) {
+                continue;
+            }
+            SmallVector<BasicBlock *, 16> vecRegion;
+            if (!getColdRegion(&B, DT, vecRegion)) {
+                continue;
+            }
+            unsigned numRegion = getInstNum(vecRegion);
+            if (numInst - numRegion > inlineThreshold) {
+                continue;
+            }
+            // colder first, then larger
+            if (Prob < BestProb || numRegion > numBest) {
+                vecBest = vecRegion;
+                numBest = numRegion;
+                BestProb = Prob;
+            }
+        }
+        if (vecBest.empty()) {
+            return false;
+        }
+
+        CodeExtractor Extractor(vecBest, &DT);
+        if (!Extractor.isEligible()) {
+            return false;
+        }
+        Function *Cold = Extractor.extractCodeRegion();
+        if (!Cold) {
+            return false;
+        }
+        Cold->addFnAttr(Attribute::Cold);
+        Cold->addFnAttr(Attribute::NoInline);
+        errs() << "outline " << F.getName() << ": " << numInst << " -> " << getInstNum(F) << "\n";
+        return true;
+    }
+
     char FuncInlinePass::ID = 0;
 
     FuncInlinePass::FuncInlinePass() : ModulePass(ID) {}
@@ -52,12 +170,28 @@ namespace func_inline_pass {
                 "aprof_final"
         };
 
-        std::set<CallInst *> setCallInstToInline;
+        std::set<std::string> &setInlineFuncName =
+                libInline == 1 ? setRuntimeInlineFuncName : setHookInlineFuncName;
 
-        for (Function &F : M) {
-            if (getBBNum(F) > MAX_BB_SIZE) {
+        // Inline only the fast path of a hook, whatever the size of its callers
+        std::map<Function *, unsigned> mapInlineFuncSize;
+        for (const std::string &name : setInlineFuncName) {
+            Function *F = M.getFunction(name);
+            if (!F || F->isDeclaration()) {
                 continue;
             }
+            if (!outlineSlowPath(*F)) {
+                errs() << "no slow path to outline: " << name << "\n";
+            }
+            mapInlineFuncSize[F] = getInstNum(*F);
+        }
+
+        std::set<CallInst *> setCallInstToInline;
+        unsigned numSkipped = 0;
+
+        for (Function &F : M) {
+            // inlining into cold code only grows it
+            bool isColdCaller = F.hasFnAttribute(Attribute::Cold);
             for (BasicBlock &B : F) {
                 for (Instruction &I : B) {
                     if (isa<CallInst>(&I)) {
@@ -65,19 +199,15 @@ namespace func_inline_pass {
                         CallSite cs(&I);
                         Function *callee = dyn_cast<Function>(cs.getCalledValue()->stripPointerCasts());
 
-                        if (libInline == 1) {
-                            if (callee && setRuntimeInlineFuncName.find(callee->getName().str()) !=
-                                          setRuntimeInlineFuncName.end()) {
-                                CallInst *pCall = dyn_cast<CallInst>(&I);
-                                setCallInstToInline.insert(pCall);
-                            }
-                        } else {
-                            if (callee &&
-                                setHookInlineFuncName.find(callee->getName().str()) != setHookInlineFuncName.end()) {
-                                CallInst *pCall = dyn_cast<CallInst>(&I);
-                                setCallInstToInline.insert(pCall);
-                            }
+                        if (!callee || callee == &F || mapInlineFuncSize.find(callee) == mapInlineFuncSize.end()) {
+                            continue;
                         }
+                        if (isColdCaller || mapInlineFuncSize[callee] > inlineThreshold) {
+                            ++numSkipped;
+                            continue;
+                        }
+                        CallInst *pCall = dyn_cast<CallInst>(&I);
+                        setCallInstToInline.insert(pCall);
                     }
                 }
             }
@@ -95,6 +225,8 @@ namespace func_inline_pass {
             }
         }
 
+        errs() << "inlined: " << setCallInstToInline.size() << ", skipped: " << numSkipped << "\n";
+
         return true;
     }
 }
@@ -2,22 +2,41 @@
 
 #include "InHouseHookPass/InHouseHookPass.h"
 
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Dominators.h"
+#include "llvm/InitializePasses.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/CallSite.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/IR/TypeFinder.h"
 #include "llvm/Support/raw_os_ostream.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
 
+#include "Common/AffineAccess.h"
 #include "Common/InputFileParser.h"
 #include "Common/Helper.h"
 #include "Common/BBProfiling.h"
 #include "Common/MonitorRWInsts.h"
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 using namespace llvm;
 
 namespace inhouse_hook_pass
@@ -25,6 +44,11 @@ namespace inhouse_hook_pass
 
 STATISTIC(NumRWInsts, "The # of RW Insts");
 STATISTIC(NumCost, "The # of Costs");
+STATISTIC(NumCostPromoted, "The # of Cost Counters Promoted to Registers");
+STATISTIC(NumElimRead, "The # of Eliminated aprof_read Hooks");
+STATISTIC(NumElimWrite, "The # of Eliminated aprof_write Hooks");
+STATISTIC(NumRangeRW, "The # of Affine RW Insts Summarized by Range Hooks");
+STATISTIC(NumLeafElided, "The # of Leaf Funcs Whose Frame is Elided");
 
 static cl::opt<std::string> strEntryFunc("entry-func",
                                          cl::desc("Entry Function Name"), cl::Optional,
@@ -39,16 +63,39 @@ static cl::opt<bool> bNoOptInst("bNoOptInst", cl::desc("No Opt for Num of Instru
 static cl::opt<bool> bNoOptCost("bNoOptCost", cl::desc("No Opt for Merging Cost"), cl::Optional,
                                 cl::value_desc("bNoOptCost"));
 
+static cl::opt<bool> bNoOptLeaf("bNoOptLeaf", cl::desc("No Opt for Eliding Frames of Leaf Funcs"), cl::Optional,
+                                cl::value_desc("bNoOptLeaf"));
+
+static cl::opt<bool> bProfileOnly("profile-only",
+                                  cl::desc("Only Record Calls and Costs (No RW Hooks), to Select the Func List"),
+                                  cl::Optional, cl::value_desc("bProfileOnly"));
+
+static cl::opt<bool> bRangeHooks("range-hooks",
+                                 cl::desc("Summarize Affine Loop Accesses by aprof_read_range/aprof_write_range"),
+                                 cl::Optional, cl::value_desc("bRangeHooks"));
+
+static cl::opt<unsigned> uAnalysisThreads("analysis-threads",
+                                          cl::desc("Num of Threads Analyzing Funcs before Instrumenting (0: One per Core)"),
+                                          cl::Optional, cl::init(0), cl::value_desc("uAnalysisThreads"));
+
 char InHouseHookPass::ID = 0;
 
 InHouseHookPass::InHouseHookPass() : ModulePass(ID) {
     PassRegistry &Registry = *PassRegistry::getPassRegistry();
     initializeDominatorTreeWrapperPassPass(Registry);
+    initializeAAResultsWrapperPassPass(Registry);
+    initializeLoopInfoWrapperPassPass(Registry);
+    initializeAssumptionCacheTrackerPass(Registry);
+    initializeTargetLibraryInfoWrapperPassPass(Registry);
 }
 
 void InHouseHookPass::getAnalysisUsage(llvm::AnalysisUsage &AU) const {
     AU.setPreservesAll();
     AU.addRequired<DominatorTreeWrapperPass>();
+    AU.addRequired<AAResultsWrapperPass>();
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<AssumptionCacheTracker>();
+    AU.addRequired<TargetLibraryInfoWrapperPass>();
 }
 
 bool InHouseHookPass::runOnModule(llvm::Module &M)
@@ -92,8 +139,6 @@ bool InHouseHookPass::runOnModule(llvm::Module &M)
         GetFuncList(setFuncList);
     }
 
-    InstrumentEntryFunc(EntryFunc);
-
     // remove global ctors and their callees
     std::set<Function *> setTextStartupFuncList;
     for (Function &F : M)
@@ -133,71 +178,327 @@ bool InHouseHookPass::runOnModule(llvm::Module &M)
         }
     }
 
+    // The entry func first
+    std::vector<Function *> vecFuncs;
+    vecFuncs.push_back(EntryFunc);
     for (Function *F : setFuncList)
     {
         if (!IsIgnoreFunc(F) && F != EntryFunc && Visited.find(F) == Visited.end())
         {
-            // errs().write_escaped(F->getName()) << "\n";
-            InstrumentFunc(F);
+            vecFuncs.push_back(F);
         }
     }
 
-    errs() << "NumRWInsts:" << NumRWInsts << ", NumCost:" << NumCost << "\n";
+    // The group prints its report once, when the timers go out of scope
+    TimerGroup PhaseTimers("InHouseHookPass", "InHouseHookPass Phases");
+    Timer AnalysisTimer("analysis", "Analysis (Parallel)", PhaseTimers);
+    Timer InstrumentTimer("instrument", "Instrumentation (Serial)", PhaseTimers);
+
+    // Analysis phase: funcs are independent and only read, analyze them in parallel.
+    // getMetadata(StringRef) registers an unknown kind in the context: register it before.
+    M.getContext().getMDKindID("ins_id");
+    // Type::isSized() caches its result in the struct type (isMonitoredLoad/Store): fill the cache before.
+    // The workers neither query the DataLayout (its struct layouts are cached too) nor print.
+    TypeFinder StructTypes;
+    StructTypes.run(M, false);
+    for (StructType *ST : StructTypes)
+    {
+        ST->isSized();
+    }
+    std::vector<FuncAnalysis> vecAnalysis(vecFuncs.size());
+    AnalysisTimer.startTimer();
+    {
+        unsigned NumThreads = uAnalysisThreads;
+        if (NumThreads == 0)
+        {
+            NumThreads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        std::atomic<size_t> NextFunc(0);
+        auto Worker = [&vecFuncs, &vecAnalysis, &NextFunc]() {
+            for (size_t i = NextFunc++; i < vecFuncs.size(); i = NextFunc++)
+            {
+                AnalyzeFunc(vecFuncs[i], vecAnalysis[i]);
+            }
+        };
+        std::vector<std::thread> vecThreads;
+        for (unsigned i = 1; i < std::min<size_t>(NumThreads, vecFuncs.size()); ++i)
+        {
+            vecThreads.emplace_back(Worker);
+        }
+        Worker();
+        for (std::thread &T : vecThreads)
+        {
+            T.join();
+        }
+    }
+    AnalysisTimer.stopTimer();
+
+    // Instrumentation phase: changes the IR and queries the pass manager, in order
+    InstrumentTimer.startTimer();
+    InstrumentEntryFunc(EntryFunc, vecAnalysis[0]);
+    for (size_t i = 1; i < vecFuncs.size(); ++i)
+    {
+        // errs().write_escaped(vecFuncs[i]->getName()) << "\n";
+        InstrumentFunc(vecFuncs[i], vecAnalysis[i]);
+    }
+    InstrumentTimer.stopTimer();
+
+    errs() << "NumRWInsts:" << NumRWInsts << ", NumCost:" << NumCost << ", NumElimRead:" << NumElimRead
+           << ", NumElimWrite:" << NumElimWrite << ", NumLeafElided:" << NumLeafElided << "\n";
 
     return true;
 }
 
-static void removeByDomInfo(common::MonitoredRWInsts &MI, DominatorTree &DT)
+static bool isCallInst(Instruction *I)
 {
-    std::map<Value *, std::set<Instruction *>> AliasedInsts;
-    for (auto &kv : MI.mapLoadID)
+    return (isa<CallInst>(I) || isa<InvokeInst>(I)) && !isa<IntrinsicInst>(I);
+}
+
+// Return true if a call may run between Dom and I (Dom dominates I) without executing Dom again
+static bool hasCallBetween(Instruction *Dom, Instruction *I)
+{
+    BasicBlock *DomBB = Dom->getParent();
+    BasicBlock *BB = I->getParent();
+    if (DomBB == BB)
     {
-        Value *V = kv.first->getPointerOperand();
-        if (AliasedInsts.find(V) == AliasedInsts.end())
+        for (auto it = Dom->getIterator(); &*it != I; ++it)
         {
-            AliasedInsts[V] = std::set<Instruction *>();
+            if (isCallInst(&*it))
+            {
+                return true;
+            }
         }
-        AliasedInsts[V].insert(kv.first);
+        return false;
     }
-    for (auto &kv : MI.mapStoreID)
+
+    for (auto it = std::next(Dom->getIterator()); it != DomBB->end(); ++it)
+    {
+        if (isCallInst(&*it))
+        {
+            return true;
+        }
+    }
+    for (auto it = BB->begin(); &*it != I; ++it)
+    {
+        if (isCallInst(&*it))
+        {
+            return true;
+        }
+    }
+
+    // Blocks on a path DomBB -> BB, re-entering DomBB would execute Dom again
+    std::set<BasicBlock *> setForward;
+    std::vector<BasicBlock *> WorkList(succ_begin(DomBB), succ_end(DomBB));
+    while (!WorkList.empty())
+    {
+        BasicBlock *Curr = WorkList.back();
+        WorkList.pop_back();
+        if (Curr == DomBB || Curr == BB || !setForward.insert(Curr).second)
+        {
+            continue;
+        }
+        WorkList.insert(WorkList.end(), succ_begin(Curr), succ_end(Curr));
+    }
+    std::set<BasicBlock *> setBackward;
+    WorkList.assign(pred_begin(BB), pred_end(BB));
+    while (!WorkList.empty())
+    {
+        BasicBlock *Curr = WorkList.back();
+        WorkList.pop_back();
+        if (Curr == DomBB || Curr == BB || !setBackward.insert(Curr).second)
+        {
+            continue;
+        }
+        WorkList.insert(WorkList.end(), pred_begin(Curr), pred_end(Curr));
+    }
+    for (BasicBlock *Curr : setForward)
+    {
+        if (setBackward.find(Curr) == setBackward.end())
+        {
+            continue;
+        }
+        for (Instruction &II : *Curr)
+        {
+            if (isCallInst(&II))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// GetUnderlyingObject without its InstructionSimplify step, which may create constants in the context:
+// safe to call from several threads
+static Value *getUnderlyingObjectNoSimplify(Value *V)
+{
+    // Same lookup limit as GetUnderlyingObject
+    for (unsigned i = 0; i < 6; ++i)
     {
-        Value *V = kv.first->getPointerOperand();
-        if (AliasedInsts.find(V) == AliasedInsts.end())
+        if (GEPOperator *GEP = dyn_cast<GEPOperator>(V))
+        {
+            V = GEP->getPointerOperand();
+        }
+        else if (Operator::getOpcode(V) == Instruction::BitCast ||
+                 Operator::getOpcode(V) == Instruction::AddrSpaceCast)
+        {
+            V = cast<Operator>(V)->getOperand(0);
+        }
+        else if (GlobalAlias *GA = dyn_cast<GlobalAlias>(V))
+        {
+            if (GA->isInterposable())
+            {
+                return V;
+            }
+            V = GA->getAliasee();
+        }
+        else
         {
-            AliasedInsts[V] = std::set<Instruction *>();
+            return V;
         }
-        AliasedInsts[V].insert(kv.first);
+    }
+    return V;
+}
+
+/*
+ * An access to an address already accessed in the same frame cannot change the RMS:
+ * a load/store is redundant if a dominating load/store must-aliases it, covers its bytes,
+ * and no call may run in between.
+ * Collect each load/store with the dominating ones on the same object and no call in between (analysis phase).
+ */
+static void collectRedundantCandidates(
+    common::MonitoredRWInsts &MI, DominatorTree &DT,
+    std::vector<std::pair<Instruction *, std::vector<Instruction *>>> &vecCandidates)
+{
+    std::map<Value *, std::vector<Instruction *>> mapObjectInsts;
+    for (auto &kv : MI.mapLoadID)
+    {
+        mapObjectInsts[getUnderlyingObjectNoSimplify(kv.first->getPointerOperand())].push_back(kv.first);
+    }
+    for (auto &kv : MI.mapStoreID)
+    {
+        mapObjectInsts[getUnderlyingObjectNoSimplify(kv.first->getPointerOperand())].push_back(kv.first);
     }
 
-    for (auto &kv : AliasedInsts)
+    for (auto &kv : mapObjectInsts)
     {
-        if (!common::hasNonLoadStoreUse(kv.first) && kv.second.size() > 1)
+        if (kv.second.size() < 2)
         {
-            for (Instruction *rhs : kv.second)
+            continue;
+        }
+        for (Instruction *I : kv.second)
+        {
+            std::vector<Instruction *> vecDom;
+            for (Instruction *Dom : kv.second)
             {
-                for (Instruction *lhs : kv.second)
+                if (Dom == I || !DT.dominates(Dom, I) || hasCallBetween(Dom, I))
                 {
-                    if (lhs != rhs)
-                    {
-                        if (DT.dominates(lhs, rhs))
-                        {
-                            if (LoadInst *LI = dyn_cast<LoadInst>(rhs))
-                            {
-                                // LI->dump();
-                                MI.mapLoadID.erase(LI);
-                            }
-                            else if (StoreInst *SI = dyn_cast<StoreInst>(rhs))
-                            {
-                                // SI->dump();
-                                MI.mapStoreID.erase(SI);
-                            }
-                            break;
-                        }
-                    }
+                    continue;
                 }
+                vecDom.push_back(Dom);
+            }
+            if (!vecDom.empty())
+            {
+                vecCandidates.emplace_back(I, std::move(vecDom));
+            }
+        }
+    }
+}
+
+// Remove the candidates must-aliased and covered by one of their dominating accesses (instrumentation phase:
+// AA is not thread safe, MemoryLocation::get fills the struct layout cache of the DataLayout)
+static void removeByAliasInfo(
+    common::MonitoredRWInsts &MI, AliasAnalysis &AA,
+    const std::vector<std::pair<Instruction *, std::vector<Instruction *>>> &vecCandidates)
+{
+    for (auto &kv : vecCandidates)
+    {
+        Instruction *I = kv.first;
+        MemoryLocation Loc = MemoryLocation::get(I);
+        for (Instruction *Dom : kv.second)
+        {
+            MemoryLocation DomLoc = MemoryLocation::get(Dom);
+            if (DomLoc.Size < Loc.Size || AA.alias(DomLoc, Loc) != MustAlias)
+            {
+                continue;
+            }
+            if (LoadInst *LI = dyn_cast<LoadInst>(I))
+            {
+                MI.mapLoadID.erase(LI);
+                ++NumElimRead;
+            }
+            else if (StoreInst *SI = dyn_cast<StoreInst>(I))
+            {
+                MI.mapStoreID.erase(SI);
+                ++NumElimWrite;
+            }
+            break;
+        }
+    }
+}
+
+/// Whether every load/store of pLoop that MI monitors is in setSummarized, calls are checked by common::HasCallInLoop
+static bool isLoopSummarized(Loop *pLoop, common::MonitoredRWInsts &MI, std::set<Instruction *> &setSummarized)
+{
+    for (BasicBlock *BB : pLoop->blocks())
+    {
+        for (Instruction &II : *BB)
+        {
+            bool isMonitored = false;
+            if (LoadInst *pLoad = dyn_cast<LoadInst>(&II))
+            {
+                isMonitored = MI.mapLoadID.find(pLoad) != MI.mapLoadID.end();
+            }
+            else if (StoreInst *pStore = dyn_cast<StoreInst>(&II))
+            {
+                isMonitored = MI.mapStoreID.find(pStore) != MI.mapStoreID.end();
+            }
+            if (isMonitored && setSummarized.find(&II) == setSummarized.end())
+            {
+                return false;
             }
         }
     }
+    return true;
+}
+
+static bool hasCallInFunc(Function *F)
+{
+    for (BasicBlock &B : *F)
+    {
+        for (Instruction &II : B)
+        {
+            if (isCallInst(&II))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void InHouseHookPass::AnalyzeFunc(Function *F, FuncAnalysis &FA)
+{
+
+    CollectInstructions(F, FA.MI, FA.FuncEntryInst, FA.mapBBTermInst, FA.setFuncExitInst);
+    if (bProfileOnly) {
+        FA.MI.clear();
+    }
+    if (!bNoOptInst && !FA.MI.empty()) {
+        DominatorTree DT(*F);
+        collectRedundantCandidates(FA.MI, DT, FA.vecRedundantCandidates);
+    }
+    FA.bHasCall = hasCallInFunc(F);
+    if (!bNoOptCost) {
+        // Increment only the chords of a spanning tree, one query chord per exit
+        FA.pGraph.reset(new BBProfilingGraph(*F));
+        FA.pGraph->init();
+        FA.pGraph->splitNotExitBlock();
+        FA.pGraph->calculateSpanningTree();
+
+        FA.pGraph->addQueryChords();
+        FA.pGraph->calculateChordIncrements();
+    }
 }
 
 void InHouseHookPass::SetupInit()
@@ -273,6 +574,17 @@ void InHouseHookPass::SetupFunctions()
         this->aprof_read->setCallingConv(CallingConv::C);
         ArgTypes.clear();
     }
+    // void aprof_increment_cost(unsigned long numCost);
+    this->aprof_increment_cost = this->pModule->getFunction("aprof_increment_cost");
+    if (!this->aprof_increment_cost)
+    {
+        ArgTypes.push_back(this->LongType);
+        FunctionType *AprofIncrementCostType = FunctionType::get(this->VoidType, ArgTypes, false);
+        this->aprof_increment_cost = Function::Create(AprofIncrementCostType, GlobalValue::ExternalLinkage,
+                                                      "aprof_increment_cost", this->pModule);
+        this->aprof_increment_cost->setCallingConv(CallingConv::C);
+        ArgTypes.clear();
+    }
     // void aprof_call_before(unsigned funcId);
     this->aprof_call_before = this->pModule->getFunction("aprof_call_before");
     if (!this->aprof_call_before)
@@ -305,6 +617,34 @@ void InHouseHookPass::SetupFunctions()
         this->aprof_final->setCallingConv(CallingConv::C);
         ArgTypes.clear();
     }
+    // void aprof_read_range(unsigned long start_addr, long stride, unsigned long length, unsigned long num);
+    this->aprof_read_range = this->pModule->getFunction("aprof_read_range");
+    if (!this->aprof_read_range)
+    {
+        ArgTypes.push_back(this->LongType);
+        ArgTypes.push_back(this->LongType);
+        ArgTypes.push_back(this->LongType);
+        ArgTypes.push_back(this->LongType);
+        FunctionType *AprofReadRangeType = FunctionType::get(this->VoidType, ArgTypes, false);
+        this->aprof_read_range = Function::Create(AprofReadRangeType, GlobalValue::ExternalLinkage,
+                                                  "aprof_read_range", this->pModule);
+        this->aprof_read_range->setCallingConv(CallingConv::C);
+        ArgTypes.clear();
+    }
+    // void aprof_write_range(unsigned long start_addr, long stride, unsigned long length, unsigned long num);
+    this->aprof_write_range = this->pModule->getFunction("aprof_write_range");
+    if (!this->aprof_write_range)
+    {
+        ArgTypes.push_back(this->LongType);
+        ArgTypes.push_back(this->LongType);
+        ArgTypes.push_back(this->LongType);
+        ArgTypes.push_back(this->LongType);
+        FunctionType *AprofWriteRangeType = FunctionType::get(this->VoidType, ArgTypes, false);
+        this->aprof_write_range = Function::Create(AprofWriteRangeType, GlobalValue::ExternalLinkage,
+                                                   "aprof_write_range", this->pModule);
+        this->aprof_write_range->setCallingConv(CallingConv::C);
+        ArgTypes.clear();
+    }
 }
 
 void InHouseHookPass::GetFuncList(const std::set<unsigned> &setFuncIDList, std::set<Function *> &setFuncList)
@@ -381,19 +721,21 @@ void InHouseHookPass::CollectInstructions(Function *F, common::MonitoredRWInsts
     }
 }
 
-void InHouseHookPass::InstrumentEntryFunc(Function *EntryFunc)
+void InHouseHookPass::InstrumentEntryFunc(Function *EntryFunc, FuncAnalysis &FA)
 {
 
-    common::MonitoredRWInsts MI;
-    Instruction *FuncEntryInst = nullptr;                 // call_before loc
-    std::map<BasicBlock *, Instruction *> mapBBTermInst; // cost loc
-    std::set<Instruction *> setFuncExitInst;              // return loc
+    common::MonitoredRWInsts &MI = FA.MI;
+    Instruction *FuncEntryInst = FA.FuncEntryInst;
+    std::map<BasicBlock *, Instruction *> &mapBBTermInst = FA.mapBBTermInst;
+    std::set<Instruction *> &setFuncExitInst = FA.setFuncExitInst;
 
-    DominatorTree &DT = getAnalysis<DominatorTreeWrapperPass>(*EntryFunc).getDomTree();
-    CollectInstructions(EntryFunc, MI, FuncEntryInst, mapBBTermInst, setFuncExitInst);
     DEBUG(dbgs() << EntryFunc->getName() << ", " << mapBBTermInst.size() << ", " << setFuncExitInst.size() << "\n");
-    if (!bNoOptInst) {
-        removeByDomInfo(MI, DT);
+    if (!FA.vecRedundantCandidates.empty()) {
+        AliasAnalysis &AA = getAnalysis<AAResultsWrapperPass>(*EntryFunc).getAAResults();
+        removeByAliasInfo(MI, AA, FA.vecRedundantCandidates);
+    }
+    if (bRangeHooks) {
+        InstrumentAffineLoops(EntryFunc, MI);
     }
     NumRWInsts += MI.size();
 
@@ -406,25 +748,33 @@ void InHouseHookPass::InstrumentEntryFunc(Function *EntryFunc)
     InstrumentCostAlloc(BBAllocInst, FuncEntryInst);
 
     // InstrumentParams(EntryFunc, BBAllocInst, FuncEntryInst);
-    // InstrumentCostAdd(BBAllocInst, mapBBTermInst);
+    InstrumentCostAdd(BBAllocInst, mapBBTermInst, FA.pGraph.get());
     InstrumentRW(MI);
     InstrumentReturn(BBAllocInst, setFuncExitInst);
     InstrumentFinal(setFuncExitInst);
+    PromoteCost(BBAllocInst);
 }
 
-void InHouseHookPass::InstrumentFunc(Function *F)
+void InHouseHookPass::InstrumentFunc(Function *F, FuncAnalysis &FA)
 {
 
-    common::MonitoredRWInsts MI;
-    Instruction *FuncEntryInst = nullptr;                 // call_before loc
-    std::map<BasicBlock *, Instruction *> mapBBTermInst; // cost loc
-    std::set<Instruction *> setFuncExitInst;              // return loc
+    common::MonitoredRWInsts &MI = FA.MI;
+    Instruction *FuncEntryInst = FA.FuncEntryInst;
+    std::map<BasicBlock *, Instruction *> &mapBBTermInst = FA.mapBBTermInst;
+    std::set<Instruction *> &setFuncExitInst = FA.setFuncExitInst;
 
-    DominatorTree &DT = getAnalysis<DominatorTreeWrapperPass>(*F).getDomTree();
-    CollectInstructions(F, MI, FuncEntryInst, mapBBTermInst, setFuncExitInst);
     DEBUG(dbgs() << F->getName() << ", " << mapBBTermInst.size() << ", " << setFuncExitInst.size() << "\n");
-    if (!bNoOptInst) {
-        removeByDomInfo(MI, DT);
+    if (!FA.vecRedundantCandidates.empty()) {
+        AliasAnalysis &AA = getAnalysis<AAResultsWrapperPass>(*F).getAAResults();
+        removeByAliasInfo(MI, AA, FA.vecRedundantCandidates);
+    }
+    // Under profile-only every func has an empty MI, but the profile must still list the hot leaf funcs
+    if (!bNoOptLeaf && !bProfileOnly && MI.empty() && !FA.bHasCall) {
+        InstrumentLeafFunc(FuncEntryInst, mapBBTermInst, setFuncExitInst, FA.pGraph.get());
+        return;
+    }
+    if (bRangeHooks) {
+        InstrumentAffineLoops(F, MI);
     }
     NumRWInsts += MI.size();
 
@@ -435,9 +785,10 @@ void InHouseHookPass::InstrumentFunc(Function *F)
     InstrumentCostAlloc(BBAllocInst, FuncEntryInst);
 
     // InstrumentParams(F, BBAllocInst, FuncEntryInst);
-    // InstrumentCostAdd(BBAllocInst, mapBBTermInst);
+    InstrumentCostAdd(BBAllocInst, mapBBTermInst, FA.pGraph.get());
     InstrumentRW(MI);
     InstrumentReturn(BBAllocInst, setFuncExitInst);
+    PromoteCost(BBAllocInst);
 }
 
 void InHouseHookPass::InstrumentInit(llvm::Instruction *InsertBefore)
@@ -501,20 +852,13 @@ void InHouseHookPass::InstrumentParams(Function *F, AllocaInst *BBAllocInst, Ins
     }
 }
 
-void InHouseHookPass::InstrumentCostAdd(AllocaInst *BBAllocInst, std::map<BasicBlock *, Instruction *> &mapBBTermInst)
+void InHouseHookPass::InstrumentCostAdd(AllocaInst *BBAllocInst, std::map<BasicBlock *, Instruction *> &mapBBTermInst,
+                                        BBProfilingGraph *bbGraph)
 {
 
-    Function *F = BBAllocInst->getFunction();
-    if (!bNoOptCost && getExitBlockSize(F) == 1) {
-        BBProfilingGraph bbGraph = BBProfilingGraph(*F);
-
-        bbGraph.init();
-        bbGraph.splitNotExitBlock();
-        bbGraph.calculateSpanningTree();
-
-        BBProfilingEdge *pQueryEdge = bbGraph.addQueryChord();
-        bbGraph.calculateChordIncrements();
-        NumCost += bbGraph.instrumentLocalCounterUpdate(BBAllocInst);
+    if (!bNoOptCost) {
+        // Chord increments computed by AnalyzeFunc
+        NumCost += bbGraph->instrumentLocalCounterUpdate(BBAllocInst);
     } else {
         for (auto &BBTermInst : mapBBTermInst)
         {
@@ -529,6 +873,99 @@ void InHouseHookPass::InstrumentCostAdd(AllocaInst *BBAllocInst, std::map<BasicB
     }
 }
 
+void InHouseHookPass::PromoteCost(AllocaInst *BBAllocInst)
+{
+
+    // The cost is only loaded/stored by the instrumentation: keep it in registers
+    if (bNoOptCost || !isAllocaPromotable(BBAllocInst))
+    {
+        return;
+    }
+    // Recompute the dominator tree, critical edges may have been split by InstrumentCostAdd
+    DominatorTree &DT = getAnalysis<DominatorTreeWrapperPass>(*BBAllocInst->getFunction()).getDomTree();
+    PromoteMemToReg({BBAllocInst}, DT);
+    ++NumCostPromoted;
+}
+
+void InHouseHookPass::InstrumentAffineLoops(Function *F, common::MonitoredRWInsts &MI)
+{
+
+    // Each getAnalysis(*F) re-runs the function passes: AA last, SE built locally so that both stay valid
+    DominatorTree &DT = getAnalysis<DominatorTreeWrapperPass>(*F).getDomTree();
+    LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>(*F).getLoopInfo();
+    AliasAnalysis &AliasInfo = getAnalysis<AAResultsWrapperPass>(*F).getAAResults();
+    std::unique_ptr<ScalarEvolution> SE = common::BuildScalarEvolution(*this, *F, DT, LI);
+
+    for (Loop *pLoop : LI.getLoopsInPreorder())
+    {
+        // No call may run in the loop: its accesses belong to one frame with a constant time stamp
+        if (!pLoop->empty() || common::HasCallInLoop(pLoop))
+        {
+            continue;
+        }
+
+        std::vector<common::AffineAccess> vecAffine;
+        const SCEV *TripCount = common::CollectAffineAccesses(pLoop, *SE, DT, AliasInfo, vecAffine);
+        if (!TripCount)
+        {
+            continue;
+        }
+
+        // The range hooks run at the loop exit: a hook left per iteration would be reordered against them
+        std::set<Instruction *> setSummarized;
+        for (common::AffineAccess &AA : vecAffine)
+        {
+            setSummarized.insert(AA.pInst);
+        }
+        if (!isLoopSummarized(pLoop, MI, setSummarized))
+        {
+            continue;
+        }
+
+        // Replace the per-iteration hooks by one range hook at the loop exit, in program order
+        SCEVExpander Expander(*SE, this->pModule->getDataLayout(), "range");
+        Instruction *pPreheaderTerm = pLoop->getLoopPreheader()->getTerminator();
+        Instruction *pExitInst = &*pLoop->getUniqueExitBlock()->getFirstInsertionPt();
+        Value *pTripCount = nullptr;
+        for (common::AffineAccess &AA : vecAffine)
+        {
+            bool isMonitored = AA.isStore ? MI.mapStoreID.erase(cast<StoreInst>(AA.pInst)) > 0
+                                          : MI.mapLoadID.erase(cast<LoadInst>(AA.pInst)) > 0;
+            if (!isMonitored)
+            {
+                continue;
+            }
+            if (!pTripCount)
+            {
+                pTripCount = Expander.expandCodeFor(TripCount, this->LongType, pPreheaderTerm);
+            }
+            Value *pStart = Expander.expandCodeFor(AA.Start, AA.Start->getType(), pPreheaderTerm);
+            InstrumentRange(pStart, AA.Stride, AA.ElemSize, pTripCount, AA.isStore, pExitInst);
+            ++NumRangeRW;
+        }
+    }
+}
+
+void InHouseHookPass::InstrumentRange(Value *pStart, int Stride, unsigned ElemSize, Value *pTripCount, bool isStore,
+                                      Instruction *InsertBefore)
+{
+
+    assert(pStart && pTripCount && InsertBefore);
+
+    CastInst *int64_address = new PtrToIntInst(pStart, this->LongType, "", InsertBefore);
+    std::vector<Value *> params;
+    params.push_back(int64_address);
+    params.push_back(ConstantInt::get(this->LongType, Stride, true));
+    params.push_back(ConstantInt::get(this->LongType, ElemSize));
+    params.push_back(pTripCount);
+    CallInst *pCall = CallInst::Create(isStore ? this->aprof_write_range : this->aprof_read_range, params, "",
+                                       InsertBefore);
+    pCall->setCallingConv(CallingConv::C);
+    pCall->setTailCall(false);
+    AttributeList empty;
+    pCall->setAttributes(empty);
+}
+
 void InHouseHookPass::InstrumentRW(common::MonitoredRWInsts &MI)
 {
 
@@ -593,6 +1030,36 @@ void InHouseHookPass::InstrumentReturn(AllocaInst *BBAllocInst, std::set<Instruc
     }
 }
 
+/*
+ * A leaf func without monitored accesses has an RMS of 0:
+ * instead of pushing a frame and logging a record, add its cost to the frame of its caller.
+ */
+void InHouseHookPass::InstrumentLeafFunc(Instruction *FuncEntryInst, std::map<BasicBlock *, Instruction *> &mapBBTermInst,
+                                         std::set<Instruction *> &setFuncExitInst, BBProfilingGraph *bbGraph)
+{
+
+    AllocaInst *BBAllocInst = nullptr;
+    InstrumentCostAlloc(BBAllocInst, FuncEntryInst);
+    InstrumentCostAdd(BBAllocInst, mapBBTermInst, bbGraph);
+
+    for (Instruction *II : setFuncExitInst)
+    {
+        std::vector<Value *> vecParams;
+        LoadInst *pLoad = new LoadInst(BBAllocInst, "", false, II);
+        pLoad->setAlignment(8);
+        vecParams.push_back(pLoad);
+
+        CallInst *pCall = CallInst::Create(this->aprof_increment_cost, vecParams, "", II);
+        pCall->setCallingConv(CallingConv::C);
+        pCall->setTailCall(false);
+        AttributeList empty;
+        pCall->setAttributes(empty);
+    }
+
+    PromoteCost(BBAllocInst);
+    ++NumLeafElided;
+}
+
 void InHouseHookPass::InstrumentFinal(std::set<Instruction *> &setFuncExitInst)
 {
 
@@ -778,8 +1245,7 @@ void InHouseHookPass::InstrumentOstream(Instruction *pCall, Instruction *InsertB
     pReadCall->setAttributes(empty);
 }
 
-void InHouseHookPass::FindDirectCallees(const std::set<BasicBlock *> &setBB, std::vector<Function *> &vecWorkList,
-                                        std::set<Function *> &setToDo,
+void InHouseHookPass::FindDirectCallees(const std::set<BasicBlock *> &setBB, OrdWorkList<Function *> &WorkList,
                                         std::map<Function *, std::set<Instruction *>> &funcCallSiteMapping)
 {
 
@@ -812,11 +1278,7 @@ void InHouseHookPass::FindDirectCallees(const std::set<BasicBlock *> &setBB, std
                 {
                     funcCallSiteMapping[pCalled].insert(pInst);
 
-                    if (setToDo.find(pCalled) == setToDo.end())
-                    {
-                        setToDo.insert(pCalled);
-                        vecWorkList.push_back(pCalled);
-                    }
+                    WorkList.push(pCalled);
                 }
             }
         }
@@ -827,17 +1289,16 @@ void InHouseHookPass::FindCalleesInDepth(const std::set<BasicBlock *> &setBB, st
                                          std::map<Function *, std::set<Instruction *>> &funcCallSiteMapping)
 {
 
-    // Function stack to recursively handle callees
-    std::vector<Function *> vecWorkList;
+    // Function stack to recursively handle callees, a callee is pushed once
+    OrdWorkList<Function *> WorkList;
 
     // Find in the outmost BBs
-    FindDirectCallees(setBB, vecWorkList, setToDo, funcCallSiteMapping);
+    FindDirectCallees(setBB, WorkList, funcCallSiteMapping);
 
-    while (!vecWorkList.empty())
+    while (auto next = WorkList.pop())
     {
 
-        Function *pCurrent = vecWorkList.back();
-        vecWorkList.pop_back();
+        Function *pCurrent = *next;
 
         // Store BBs in current func into set
         std::set<BasicBlock *> setCurrentBB;
@@ -845,8 +1306,10 @@ void InHouseHookPass::FindCalleesInDepth(const std::set<BasicBlock *> &setBB, st
         {
             setCurrentBB.insert(&BB);
         }
-        FindDirectCallees(setCurrentBB, vecWorkList, setToDo, funcCallSiteMapping);
+        FindDirectCallees(setCurrentBB, WorkList, funcCallSiteMapping);
     }
+
+    setToDo.insert(WorkList.getSet().begin(), WorkList.getSet().end());
 }
 
 void InHouseHookPass::CloneFunctions(std::set<Function *> &setFunc, ValueToValueMapTy &originClonedMapping)
@@ -9,30 +9,66 @@
 #include <fcntl.h>
 #include <unistd.h>
 
-struct stTrace {
+struct stSegment {
     long threadId;
-    unsigned flag;
-    unsigned funcOrInstId;
+    unsigned long reserved;
 };
 
-#define BUFFERSIZE (1UL << 33)
+struct stEdge {
+    unsigned instId;
+    unsigned funcId;
+};
+
+#define SEGMENTSIZE (1UL << 16)
 #define FUNC_PTR_TRACER_LOG "func_ptr_tracer.log"
 
-int main() {
+/*
+ * Usage: FuncPtrParser [-t]
+ * Print the resolved call edges logged by FuncPtrHooks, one "inst_id func_id" per line:
+ * a call inst followed by the entry of an instrumented func in the same thread.
+ * The output is the indirect call file of the instrumentation passes.
+ * -t: "thread_id inst_id func_id", the thread that resolved the edge first.
+ */
+int main(int argc, char *argv[]) {
+
+    bool bThreadIds = argc > 1 && strcmp(argv[1], "-t") == 0;
 
-    int fd = shm_open(FUNC_PTR_TRACER_LOG, O_RDWR, 0777);
+    int fd = shm_open(FUNC_PTR_TRACER_LOG, O_RDONLY, 0777);
     if (fd == -1) {
         fprintf(stderr, "shm_open failed: %s\n", strerror(errno));
         exit(-1);
     }
-    struct stTrace *pcBuffer = (struct stTrace *)mmap(NULL, BUFFERSIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
-    for (long iBufferIndex = 0; iBufferIndex < BUFFERSIZE/sizeof(stTrace); ++iBufferIndex) {
-        struct stTrace *pTrace = &pcBuffer[iBufferIndex];
-        if (pTrace->threadId == 0) {
-            break;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        fprintf(stderr, "fstat failed: %s\n", strerror(errno));
+        exit(-1);
+    }
+    if (st.st_size == 0) {
+        return 0;
+    }
+    char *pcBuffer = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED | MAP_NORESERVE, fd, 0);
+    if (pcBuffer == MAP_FAILED) {
+        fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+        exit(-1);
+    }
+
+    for (unsigned long offset = 0; offset + SEGMENTSIZE <= (unsigned long)st.st_size; offset += SEGMENTSIZE) {
+        struct stSegment *pSegment = (struct stSegment *)(pcBuffer + offset);
+        // a segment claimed by a thread killed before writing it
+        if (pSegment->threadId == 0) {
+            continue;
+        }
+        struct stEdge *pEnd = (struct stEdge *)(pcBuffer + offset + SEGMENTSIZE);
+        for (struct stEdge *pEdge = (struct stEdge *)(pSegment + 1); pEdge < pEnd && pEdge->funcId != 0; ++pEdge) {
+            if (bThreadIds) {
+                printf("%ld %u %u\n", pSegment->threadId, pEdge->instId, pEdge->funcId);
+            } else {
+                printf("%u %u\n", pEdge->instId, pEdge->funcId);
+            }
         }
-        printf("%ld, %u, %u\n", pTrace->threadId, pTrace->flag, pTrace->funcOrInstId);
     }
 
+    munmap(pcBuffer, st.st_size);
+    close(fd);
     return 0;
-}
\ No newline at end of file
+}
@@ -7,26 +7,45 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <stdatomic.h>
+#include <atomic>
 #include <unistd.h>
 #include <pthread.h>
 #include <sys/syscall.h>
 #define gettid() syscall(__NR_gettid)
 
-#define BUFFERSIZE (1UL << 33)
+#define MAX_EDGES (1UL << 20)
+#define BUFFERSIZE (1UL << 30)
+#define SEGMENTSIZE (1UL << 16)
 #define FUNC_PTR_TRACER_LOG "func_ptr_tracer.log"
 
-struct stTrace {
+// The log is split into segments, each one written by a single thread:
+// |stSegment|stEdge|stEdge|...|stEdge{0, 0}|
+// A thread claims a new segment on its first new edge and when its segment is full.
+// Each resolved call edge is logged once, in the segment of the first thread resolving it.
+struct stSegment {
     long threadId;
-    unsigned flag;
-    unsigned funcOrInstId;
+    unsigned long reserved;
+};
+
+struct stEdge {
+    unsigned instId;
+    unsigned funcId;
 };
 
 int fd = -1;
-struct stTrace *pcBuffer = NULL;
-unsigned long iBufferIndex = 0;
-atomic_bool lock = false;
-bool expected = false;
+char *pcBuffer = NULL;
+std::atomic<unsigned long> iNextSegment(0);
+
+// In-memory set of the edges already logged, open addressing on (instId << 32 | funcId), 0 is empty.
+// Twice as many slots as edges to keep the probes short.
+static std::atomic<unsigned long> setEdges[MAX_EDGES * 2];
+
+static __thread long tlsThreadId = 0;
+static __thread stEdge *tlsCursor = NULL;
+static __thread stEdge *tlsEnd = NULL;
+
+// The call inst the thread is in, 0 if its last event is not a call inst
+static __thread unsigned tlsCallInst = 0;
 
 void func_ptr_hook_init() {
 
@@ -36,76 +55,86 @@ void func_ptr_hook_init() {
         fprintf(stderr, "shm_open failed: %s\n", strerror(errno));
         exit(-1);
     }
-    if (ftruncate(fd, BUFFERSIZE) == -1) {
+    // drop the edges of a previous run, the segments must start zeroed
+    if (ftruncate(fd, 0) == -1 || ftruncate(fd, BUFFERSIZE) == -1) {
         fprintf(stderr, "ftruncate failed: %s\n", strerror(errno));
         exit(-1);
     }
 
-    pcBuffer = (struct stTrace *) mmap(0, BUFFERSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (pcBuffer == NULL) {
+    pcBuffer = (char *) mmap(0, BUFFERSIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+    if (pcBuffer == MAP_FAILED) {
         fprintf(stderr, "mmap failed: %s\n", strerror(errno));
         exit(-1);
     }
 }
 
+// First new edge of the thread or segment full, leave room for the ending stEdge{0, 0}
+static void claim_segment() {
+
+    if (tlsThreadId == 0) {
+        tlsThreadId = gettid();
+    }
+    unsigned long iSegment = iNextSegment.fetch_add(1, std::memory_order_relaxed);
+    if ((iSegment + 1) * SEGMENTSIZE > BUFFERSIZE) {
+        fprintf(stderr, "func ptr edge log full\n");
+        exit(-1);
+    }
+    stSegment *pSegment = (stSegment *) (pcBuffer + iSegment * SEGMENTSIZE);
+    pSegment->threadId = tlsThreadId;
+    tlsCursor = (stEdge *) (pSegment + 1);
+    tlsEnd = (stEdge *) ((char *) pSegment + SEGMENTSIZE) - 1;
+}
+
+static void record_edge(unsigned instId, unsigned funcId) {
+
+    unsigned long key = ((unsigned long) instId << 32) | funcId;
+    unsigned long mask = MAX_EDGES * 2 - 1;
+    unsigned long slot = (key * 0x9E3779B97F4A7C15UL) >> 43 & mask;
+    for (unsigned long probe = 0; probe <= mask; ++probe, slot = (slot + 1) & mask) {
+        unsigned long curr = setEdges[slot].load(std::memory_order_relaxed);
+        if (curr == 0 && setEdges[slot].compare_exchange_strong(curr, key, std::memory_order_relaxed)) {
+            // new edge, log it in the segment of the thread
+            if (tlsCursor == tlsEnd) {
+                claim_segment();
+            }
+            tlsCursor->instId = instId;
+            tlsCursor->funcId = funcId;
+            ++tlsCursor;
+            return;
+        }
+        if (curr == key) {
+            return;
+        }
+    }
+    fprintf(stderr, "func ptr edge set full: %lu edges\n", MAX_EDGES * 2);
+}
+
 void func_ptr_hook_enter_func(unsigned funcId) {
 
-    while (!atomic_compare_exchange_weak(&lock, &expected, true)) {
-        expected = false;
+    if (tlsCallInst != 0) {
+        record_edge(tlsCallInst, funcId);
+        tlsCallInst = 0;
     }
-    stTrace *pTrace = &pcBuffer[iBufferIndex];
-    pTrace->threadId = gettid();
-    pTrace->flag = 0;
-    pTrace->funcOrInstId = funcId;
-    ++iBufferIndex;
-    lock = false;
 }
 
 void func_ptr_hook_exit_func(unsigned funcId) {
 
-    while (!atomic_compare_exchange_weak(&lock, &expected, true)) {
-        expected = false;
-    }
-    stTrace *pTrace = &pcBuffer[iBufferIndex];
-    pTrace->threadId = gettid();
-    pTrace->flag = 1;
-    pTrace->funcOrInstId = funcId;
-    ++iBufferIndex;
-    lock = false;
+    tlsCallInst = 0;
 }
 
 void func_ptr_hook_call_inst(unsigned instId) {
 
-    while (!atomic_compare_exchange_weak(&lock, &expected, true)) {
-        expected = false;
-    }
-    stTrace *pTrace = &pcBuffer[iBufferIndex];
-    pTrace->threadId = gettid();
-    pTrace->flag = 2;
-    pTrace->funcOrInstId = instId;
-    ++iBufferIndex;
-    lock = false;
+    tlsCallInst = instId;
 }
 
 void func_ptr_hook_final() {
 
-    while (!atomic_compare_exchange_weak(&lock, &expected, true)) {
-        expected = false;
-    }
-    stTrace *pTrace = &pcBuffer[iBufferIndex];
-    pTrace->threadId = 0;
-    pTrace->flag = 0;
-    pTrace->funcOrInstId = 0;
-    ++iBufferIndex;
-
-    if (ftruncate(fd, sizeof(stTrace) * iBufferIndex) == -1) {
+    // keep the claimed segments only
+    if (ftruncate(fd, SEGMENTSIZE * iNextSegment.load()) == -1) {
         fprintf(stderr, "ftruncate: %s\n", strerror(errno));
         exit(-1);
     }
 
-    lock = false;
-
+    munmap(pcBuffer, BUFFERSIZE);
     close(fd);
 }
-
-
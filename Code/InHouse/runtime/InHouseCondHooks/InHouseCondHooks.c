@@ -155,6 +155,14 @@ void aprof_increment_rms(unsigned long length) {
 }
 
 
+void aprof_increment_cost(unsigned long numCost) {
+    if (!pcBuffer) {
+        return;
+    }
+    shadow_stack[stack_top].cost += numCost;
+}
+
+
 void aprof_call_before(unsigned funcId) {
     if (!pcBuffer) {
         return;
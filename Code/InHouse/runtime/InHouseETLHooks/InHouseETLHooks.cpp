@@ -187,6 +187,19 @@ void aprof_increment_rms(unsigned long length)
     shadow_stack[stack_top].rms += length;
 }
 
+void aprof_increment_cost(unsigned long numCost)
+{
+
+    if (!start_record)
+    {
+        return;
+    }
+#ifdef NDEBUG
+    printf("cost+: %lu\n", numCost);
+#endif
+    shadow_stack[stack_top].cost += numCost;
+}
+
 void aprof_call_before(unsigned funcId)
 {
 
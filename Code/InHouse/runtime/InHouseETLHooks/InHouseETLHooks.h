@@ -57,6 +57,9 @@ extern "C"
 
     void aprof_increment_rms(unsigned long length);
 
+    // fold the cost of a frame elided by the pass (a leaf without monitored accesses) into the top frame
+    void aprof_increment_cost(unsigned long numCost);
+
     void aprof_call_before(unsigned funcId);
 
     void aprof_return(unsigned long numCost);
@@ -150,12 +150,60 @@ void aprof_read(unsigned long start_addr, unsigned long length)
     }
 }
 
+// Contiguous accesses touch each byte of the span once, whatever the direction.
+// count is constant during the loop, so the order of the bytes does not matter.
+void aprof_write_range(unsigned long start_addr, long stride, unsigned long length, unsigned long num)
+{
+
+    if (num == 0)
+    {
+        return;
+    }
+    if (stride == (long)length || stride == -(long)length)
+    {
+        unsigned long lowest_addr = stride > 0 ? start_addr : start_addr + stride * (long)(num - 1);
+        aprof_write(lowest_addr, length * num);
+        return;
+    }
+    unsigned long i;
+    for (i = 0; i < num; i++, start_addr += stride)
+    {
+        aprof_write(start_addr, length);
+    }
+}
+
+void aprof_read_range(unsigned long start_addr, long stride, unsigned long length, unsigned long num)
+{
+
+    if (num == 0)
+    {
+        return;
+    }
+    if (stride == (long)length || stride == -(long)length)
+    {
+        unsigned long lowest_addr = stride > 0 ? start_addr : start_addr + stride * (long)(num - 1);
+        aprof_read(lowest_addr, length * num);
+        return;
+    }
+    unsigned long i;
+    for (i = 0; i < num; i++, start_addr += stride)
+    {
+        aprof_read(start_addr, length);
+    }
+}
+
 void aprof_increment_rms(unsigned long length)
 {
 
     shadow_stack[stack_top].rms += length;
 }
 
+void aprof_increment_cost(unsigned long numCost)
+{
+
+    shadow_stack[stack_top].cost += numCost;
+}
+
 void aprof_call_before(unsigned funcId)
 {
 
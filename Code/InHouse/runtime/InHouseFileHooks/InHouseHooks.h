@@ -45,8 +45,16 @@ void aprof_write(unsigned long start_addr, unsigned long length);
 
 void aprof_read(unsigned long start_addr, unsigned long length);
 
+// num accesses of length bytes from start_addr, start_addr + stride, ... in one frame
+void aprof_write_range(unsigned long start_addr, long stride, unsigned long length, unsigned long num);
+
+void aprof_read_range(unsigned long start_addr, long stride, unsigned long length, unsigned long num);
+
 void aprof_increment_rms(unsigned long length);
 
+// fold the cost of a frame elided by the pass (a leaf without monitored accesses) into the top frame
+void aprof_increment_cost(unsigned long numCost);
+
 void aprof_call_before(unsigned funcId);
 
 void aprof_return(unsigned long numCost);
@@ -152,6 +152,14 @@ void aprof_increment_rms(unsigned long length) {
 }
 
 
+void aprof_increment_cost(unsigned long numCost) {
+
+    if (start_record) {
+        shadow_stack[stack_top].cost += numCost;
+    }
+}
+
+
 void aprof_call_before(unsigned funcId) {
 
     if (start_record) {
@@ -186,6 +186,21 @@ void aprof_increment_rms(unsigned long length) {
 }
 
 
+void aprof_increment_cost(unsigned long numCost) {
+
+    while (!atomic_compare_exchange_weak(&lock, &expected, true)) {
+        expected = false;
+    }
+
+    if (entry_thread_id != 0 && entry_thread_id == gettid()) {
+        lock = false;
+        shadow_stack[stack_top].cost += numCost;
+    } else {
+        lock = false;
+    }
+}
+
+
 void aprof_call_before(unsigned funcId) {
 
     while (!atomic_compare_exchange_weak(&lock, &expected, true)) {
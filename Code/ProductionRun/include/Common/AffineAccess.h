@@ -0,0 +1,39 @@
+#ifndef PRODUCTIONRUN_AFFINEACCESS_H
+#define PRODUCTIONRUN_AFFINEACCESS_H
+
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instruction.h"
+#include <memory>
+#include <vector>
+
+namespace common
+{
+    /// A load/store executed once per iteration at address {Start,+,Stride}<Loop>
+    struct AffineAccess
+    {
+        llvm::Instruction *pInst;
+        const llvm::SCEV *Start;
+        int Stride;
+        unsigned ElemSize;
+        bool isStore;
+    };
+
+    /// Collect the accesses of pLoop that can be replaced by one summary record per loop execution,
+    /// in program order. Return the trip count (i64 SCEV) or nullptr if the loop cannot be summarized.
+    /// Accesses are only summarized if the loop accesses one base pointer or bases that AA proves NoAlias.
+    const llvm::SCEV *CollectAffineAccesses(llvm::Loop *pLoop, llvm::ScalarEvolution &SE, llvm::DominatorTree &DT,
+                                            llvm::AliasAnalysis &AA, std::vector<AffineAccess> &vecAffine);
+
+    /// Whether a non-intrinsic call or invoke runs in pLoop: a callee may write through the summarized bases
+    bool HasCallInLoop(llvm::Loop *pLoop);
+
+    /// The ScalarEvolution of a module pass must outlive its other analyses of F, but the wrapper pass frees it
+    /// at the next getAnalysis(F): fetch DT, LoopInfo and AA first, then build SE with this.
+    std::unique_ptr<llvm::ScalarEvolution> BuildScalarEvolution(llvm::Pass &P, llvm::Function &F,
+                                                                llvm::DominatorTree &DT, llvm::LoopInfo &LI);
+} // namespace common
+
+#endif //PRODUCTIONRUN_AFFINEACCESS_H
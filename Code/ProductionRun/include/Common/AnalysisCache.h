@@ -0,0 +1,51 @@
+#ifndef PRODUCTIONRUN_ANALYSISCACHE_H
+#define PRODUCTIONRUN_ANALYSISCACHE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace common
+{
+    /// Per-function analysis results kept on disk across runs, keyed by the function name and a structural hash.
+    /// A result is a list of integers (IDs, costs, ...) under a key naming the analysis and its options;
+    /// it is returned while the function hashes the same, so only changed functions are re-analyzed.
+    /// Results refer to IR through the IDs of IDAssigner: query and store before changing the IR,
+    /// hashes are computed once per function and kept for save().
+    class AnalysisCache
+    {
+    public:
+        /// Read the cache file, a missing file is an empty cache
+        bool load(const std::string &strPath);
+
+        /// Write every entry, those of functions not seen in this run included
+        bool save(const std::string &strPath) const;
+
+        /// Cached values of Key for F, nullptr if none or F changed since they were stored
+        const std::vector<unsigned long> *lookup(llvm::Function &F, llvm::StringRef Key);
+
+        /// Store the values of Key for F, drop the values of F stored before F changed
+        void store(llvm::Function &F, llvm::StringRef Key, std::vector<unsigned long> vecValues);
+
+        /// Hash of the instructions of F, their operands, types, IDs and debug lines, stable across runs
+        static uint64_t hashFunction(llvm::Function &F);
+
+    private:
+        struct FuncEntry
+        {
+            uint64_t Hash = 0;
+            std::map<std::string, std::vector<unsigned long>> mapValues;
+        };
+
+        uint64_t getHash(llvm::Function &F);
+
+        std::map<std::string, FuncEntry> mapEntries;
+        llvm::DenseMap<llvm::Function *, uint64_t> mapHashes;
+    };
+} // namespace common
+
+#endif //PRODUCTIONRUN_ANALYSISCACHE_H
@@ -29,6 +29,7 @@ constexpr unsigned LOOP_BEGIN = INT_MAX - 1;
 constexpr unsigned LOOP_END = INT_MAX - 2;
 constexpr unsigned LOOP_STRIDE = INT_MAX - 3;
 constexpr unsigned LOOP_NEGATIVE_STRIDE = INT_MAX - 4;
+constexpr unsigned LOOP_AFFINE = INT_MAX - 5;
 constexpr unsigned MAX_ID = INT_MAX;
 
 #endif //PRODUCTIONRUN_CONSTANT_H
@@ -7,12 +7,32 @@ namespace common
 {
     constexpr unsigned INVALID_ID = 0;
     constexpr unsigned MIN_ID = 1;
+    /// Delimiter {0, 0, DELIMIT}, or {numGlobalCost, loopID, DELIMIT} in whole-program mode
     constexpr unsigned DELIMIT = INT_MAX;
     constexpr unsigned LOOP_BEGIN = INT_MAX - 1;
     constexpr unsigned LOOP_END = INT_MAX - 2;
     constexpr unsigned LOOP_STRIDE = INT_MAX - 3;
     constexpr unsigned LOOP_NEGATIVE_STRIDE = INT_MAX - 4;
+    /// Affine summary {tripcount, stride, LOOP_AFFINE}, the next access record repeats tripcount times
+    constexpr unsigned LOOP_AFFINE = INT_MAX - 5;
+    /// Rate of the sample started by the last delimiter {rate, 0, SAMPLE_WEIGHT}, the sample stands for rate executions
+    constexpr unsigned SAMPLE_WEIGHT = INT_MAX - 6;
+    /// Linked-list summary {nodeCount, occupied | nodeSize << LINKED_LIST_SIZE_SHIFT, LOOP_LINKED_LIST}
+    /// at the exit of a sampled traversal, occupied bits of a LINKED_LIST_BITMAP_BITS bitmap of the node addresses
+    constexpr unsigned LOOP_LINKED_LIST = INT_MAX - 7;
+    /// Input bytes of the IO calls since the last flush {bytes, 0, IO_SUMMARY}, before a delimiter or the final cost
+    constexpr unsigned IO_SUMMARY = INT_MAX - 8;
     constexpr unsigned MAX_ID = INT_MAX;
+
+    /// Compact record: the length is packed into the high bits of the address, which must fit in 48 bits
+    constexpr unsigned COMPACT_LENGTH_SHIFT = 48;
+    /// Compact record: the length does not fit, an int length follows the id
+    constexpr unsigned long COMPACT_LENGTH_EXTENDED = 0xFFFF;
+
+    constexpr unsigned LINKED_LIST_SIZE_SHIFT = 16;
+    constexpr unsigned LINKED_LIST_BITMAP_BITS = 4096;
+    /// Bitmap of the words read by a summarized recursive invocation, RECURSIONBITMAPBITS of runtime RecursionSummary
+    constexpr unsigned RECURSION_BITMAP_BITS = 4096;
 } // namespace common
 
 #endif //PRODUCTIONRUN_CONSTANTS_H
\ No newline at end of file
@@ -20,6 +20,8 @@ namespace common
     unsigned GetInstructionID(Instruction *I);
     /// Get Loop ID
     unsigned GetLoopID(Loop *L);
+    /// Get the ID of the Loop headed by B, INVALID_ID if B is not a Loop header
+    unsigned GetLoopHeaderID(BasicBlock *B);
 } // namespace common
 
 #endif //PRODUCTIONRUN_IDHELPER_H
\ No newline at end of file
@@ -0,0 +1,70 @@
+#ifndef PRODUCTIONRUN_IDINDEX_H
+#define PRODUCTIONRUN_IDINDEX_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+#include <set>
+#include <vector>
+
+namespace common
+{
+    /// ID -> Function/BasicBlock/Instruction/Loop header and file:line -> Function/Loop, built with one walk
+    /// over the module, so a pass with many targets does not rescan the module per target.
+    /// Build it before cloning: the clones carry the IDs of their originals, the index keeps the originals.
+    /// Loops are indexed by their header, Loop pointers do not survive getAnalysis<LoopInfoWrapperPass>(F).
+    class IDIndex
+    {
+    public:
+        IDIndex() = default;
+
+        explicit IDIndex(llvm::Module &M) { build(M); }
+
+        /// Drop the previous index and index M
+        void build(llvm::Module &M);
+
+        llvm::Function *getFunction(unsigned FuncID) const;
+
+        llvm::BasicBlock *getBasicBlock(unsigned BBID) const;
+
+        llvm::Instruction *getInstruction(unsigned InstID) const;
+
+        llvm::BasicBlock *getLoopHeader(unsigned LoopID) const;
+
+        /// Same result as SearchFunctionByName, from the line bounds collected by build
+        llvm::Function *searchFunction(const char *FileName, const char *FunctionName, unsigned LineNo) const;
+
+        /// Same result as SearchBasicBlocksByLineNo
+        void searchBasicBlocks(llvm::Function *F, unsigned LineNo, std::set<llvm::BasicBlock *> &BBs) const;
+
+        /// Same result as SearchLoopByLineNo
+        llvm::Loop *searchLoop(llvm::Function *F, llvm::LoopInfo *LPI, unsigned LineNo) const;
+
+    private:
+        /// Lines of F in FileName
+        struct FunctionBound
+        {
+            llvm::Function *F;
+            llvm::StringRef FileName;
+            unsigned StartLine;
+            unsigned EndLine;
+        };
+
+        llvm::DenseMap<unsigned, llvm::Function *> mapFunc;
+        llvm::DenseMap<unsigned, llvm::BasicBlock *> mapBB;
+        llvm::DenseMap<unsigned, llvm::Instruction *> mapInst;
+        llvm::DenseMap<unsigned, llvm::BasicBlock *> mapLoopHeader;
+        /// In module order, then in file name order as SearchFunctionByName
+        std::vector<FunctionBound> vecBounds;
+        /// Function -> LineNo -> blocks with an instruction on the line, in block order
+        llvm::DenseMap<llvm::Function *, llvm::DenseMap<unsigned, llvm::SmallVector<llvm::BasicBlock *, 4>>>
+            mapLineBBs;
+    };
+} // namespace common
+
+#endif //PRODUCTIONRUN_IDINDEX_H
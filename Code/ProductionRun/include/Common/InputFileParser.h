@@ -2,15 +2,21 @@
 #define PRODUCTIONRUN_INPUTFILEPARSER_H
 
 #include <map>
+#include <set>
 #include "optional.h"
 
 struct ParsedLoopInfo {
     bool isArray;
+    // false if the step of the array is not a constant, step is 0 then
+    bool hasStep;
     int step;
     unsigned instID;
 };
 
+/// The loop_<file>_<line> file of LoopClassifier
 std::experimental::optional<ParsedLoopInfo> parseLoopInfo(const char *fileName);
 bool parseCallSites(const char *fileName, std::map<unsigned, std::map<unsigned, unsigned>>& mapCallSites);
+/// "inst_id func_id" per line, the resolved call edges printed by FuncPtrParser
+bool parseIndirectCalls(const char *fileName, std::map<unsigned, std::set<unsigned>>& mapIndirectCalls);
 
 #endif //PRODUCTIONRUN_INPUTFILEPARSER_H
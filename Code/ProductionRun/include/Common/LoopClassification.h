@@ -0,0 +1,57 @@
+#ifndef PRODUCTIONRUN_LOOPCLASSIFICATION_H
+#define PRODUCTIONRUN_LOOPCLASSIFICATION_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Pass.h"
+
+namespace common
+{
+    enum class LoopKind
+    {
+        Other,
+        Array,
+        LinkedList
+    };
+
+    /// Array: the Load of the array element indexed by the induction variable, and its Step.
+    /// StepValue is the loop-invariant step as matched, Step its value if it is a constant and 0 otherwise.
+    /// LinkedList: the Load of the next node, Step is 0.
+    /// A loop matching both is an Array, ListNext keeps the load of its next node for the LoopClassifier output.
+    struct LoopClass
+    {
+        LoopKind Kind;
+        llvm::LoadInst *Indvar;
+        int Step;
+        llvm::Value *StepValue;
+        llvm::LoadInst *ListNext;
+    };
+
+    /// Classify loops into array/linkedlist and find the induction variable and stride.
+    /// Loops are classified on demand and cached by their header until the next run on a function, so a pass can
+    /// query every loop of a module in one pipeline: getAnalysis<common::LoopClassification>(F).getLoopClass(L)
+    /// Query it before taking Loop pointers from LoopInfo: getAnalysis(F) re-runs LoopInfo on F.
+    struct LoopClassification : public llvm::FunctionPass
+    {
+        static char ID;
+
+        LoopClassification();
+
+        void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
+
+        bool runOnFunction(llvm::Function &F) override;
+
+        void releaseMemory() override;
+
+        void print(llvm::raw_ostream &OS, const llvm::Module *M) const override;
+
+        LoopClass getLoopClass(llvm::Loop *L);
+
+    private:
+        llvm::LoopInfo *LPI;
+        llvm::DenseMap<llvm::BasicBlock *, LoopClass> mapHeaderClass;
+    };
+} // namespace common
+
+#endif //PRODUCTIONRUN_LOOPCLASSIFICATION_H
@@ -32,6 +32,7 @@ struct MonitoredRWInsts
     map<Instruction *, unsigned> mapFgetcID;
     map<Instruction *, unsigned> mapFreadID;
     map<Instruction *, unsigned> mapOstreamID;
+    map<Instruction *, unsigned> mapIOReadID;
 
     unsigned size();
     bool empty();
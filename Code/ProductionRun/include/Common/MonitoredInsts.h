@@ -17,6 +17,8 @@ namespace common
         std::map<llvm::Instruction *, unsigned> mapFgetcID;
         std::map<llvm::Instruction *, unsigned> mapFreadID;
         std::map<llvm::Instruction *, unsigned> mapOstreamID;
+        /// read, recv, getline, fgets and std::istream::read, their input size is known after the call
+        std::map<llvm::Instruction *, unsigned> mapIOReadID;
 
         unsigned long size();
         bool empty();
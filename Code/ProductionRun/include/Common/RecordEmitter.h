@@ -0,0 +1,254 @@
+#ifndef PRODUCTIONRUN_RECORDEMITTER_H
+#define PRODUCTIONRUN_RECORDEMITTER_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include <set>
+
+namespace common
+{
+    /// Layout of one record in the trace buffer
+    enum RecordFormat
+    {
+        /// struct stMemRecord {long address; int length; int id;}, 16 bytes
+        FixedRecord,
+        /// <{long address | length << 48; int id}>, 12 bytes;
+        /// 16 bytes <{long address | 0xFFFF << 48; int id; int length}> if length is not a small constant.
+        /// The address field keeps its low 48 bits only: user space addresses fit on x86-64 with 4-level paging
+        /// and on AArch64 with 48-bit VAs (not with 5-level paging and mmap hints above 2^47). Costs, counts and
+        /// byte totals stored in the address field of special records wrap at 2^48.
+        CompactRecord
+    };
+
+    /// Where the trace buffer lives
+    enum RecordSink
+    {
+        /// One shared memory buffer per process (InitMemHooks)
+        SharedMemorySink,
+        /// One mmap-ed file per process (InitFileMemHooks)
+        FileSink,
+        /// One shared memory buffer per thread (InitThreadMemHooks), buffer, cost and sampling counters are thread local
+        PerThreadSink
+    };
+
+    /// Emits the inlined trace records shared by all ProductionRun passes.
+    /// A pass derives from it next to llvm::ModulePass and calls SetupInit() before instrumenting.
+    struct RecordEmitter
+    {
+        /// Create types, constants, globals and runtime functions in M
+        void SetupInit(llvm::Module &M);
+
+        void SetupTypes();
+
+        void SetupStructs();
+
+        void SetupConstants();
+
+        void SetupGlobals();
+
+        void SetupFunctions();
+
+        /// Append one record {address, length, id} to the trace buffer.
+        /// With keep (i1), the record is always written but the index only moves past it if keep is true.
+        void InlineSetRecord(llvm::Value *address, llvm::Value *length, llvm::Value *id, llvm::Instruction *InsertBefore,
+                             llvm::Value *keep = nullptr);
+
+        /// Flush IO_BYTES, then append {0, 0, DELIMIT}
+        void InlineHookDelimit(llvm::Instruction *InsertBefore);
+
+        /// Flush IO_BYTES, then start a sampled execution of loop loopID (whole-program mode):
+        /// {numGlobalCost, loopID, DELIMIT}
+        void InlineHookLoopDelimit(unsigned loopID, llvm::Instruction *InsertBefore);
+
+        void InlineHookLoad(llvm::LoadInst *pLoad, unsigned uID, llvm::Instruction *InsertBefore);
+
+        void InlineHookStore(llvm::StoreInst *pStore, unsigned uID, llvm::Instruction *InsertBefore);
+
+        void InlineHookMemSet(llvm::MemSetInst *pMemSet, unsigned uID, llvm::Instruction *InsertBefore);
+
+        void InlineHookMemTransfer(llvm::MemTransferInst *pMemTransfer, unsigned uID, llvm::Instruction *InsertBefore);
+
+        /// IO_BYTES += 1
+        void InlineHookFgetc(llvm::Instruction *pCall, unsigned uID, llvm::Instruction *InsertBefore);
+
+        /// IO_BYTES += the return value of fread, InsertBefore is after the call
+        void InlineHookFread(llvm::Instruction *pCall, unsigned uID, llvm::Instruction *InsertBefore);
+
+        /// IO_BYTES += the bytes read by read, recv, getline, fgets or std::istream::read, InsertBefore is after the call
+        void InlineHookIORead(llvm::Instruction *pCall, unsigned uID, llvm::Instruction *InsertBefore);
+
+        void InlineHookOstream(llvm::Instruction *pCall, unsigned uID, llvm::Instruction *InsertBefore);
+
+        /// Append {rate, 0, SAMPLE_WEIGHT} after the delimiter of a sample drawn at rate
+        void InlineHookSampleRate(llvm::Value *rate, llvm::Instruction *InsertBefore);
+
+        /// Append {tripCount, stride, LOOP_AFFINE} and {base, elemSize, ID}:
+        /// tripCount accesses of elemSize bytes starting at base, stride bytes apart
+        void InlineHookAffine(llvm::Value *base, llvm::Value *tripCount, int stride, unsigned elemSize, int ID,
+                              llvm::Instruction *InsertBefore);
+
+        /// Append {nodeCount, occupied | nodeSize << LINKED_LIST_SIZE_SHIFT, LOOP_LINKED_LIST}:
+        /// a traversal of nodeCount nodes of nodeSize bytes, hashed to occupied bits of the node bitmap
+        void InlineHookLinkedList(llvm::Value *nodeCount, llvm::Value *occupied, unsigned nodeSize,
+                                  llvm::Instruction *InsertBefore);
+
+        /// Instrument every monitored instruction in MI (common::MonitoredRWInsts or ::MonitoredRWInsts)
+        template <typename MonitoredTy>
+        void InstrumentMonitoredInsts(MonitoredTy &MI)
+        {
+            for (auto &kv : MI.mapLoadID)
+            {
+                InlineHookLoad(kv.first, kv.second, kv.first);
+            }
+            for (auto &kv : MI.mapStoreID)
+            {
+                InlineHookStore(kv.first, kv.second, kv.first);
+            }
+            for (auto &kv : MI.mapMemSetID)
+            {
+                InlineHookMemSet(kv.first, kv.second, kv.first);
+            }
+            for (auto &kv : MI.mapMemTransferID)
+            {
+                InlineHookMemTransfer(kv.first, kv.second, kv.first);
+            }
+            for (auto &kv : MI.mapFgetcID)
+            {
+                InlineHookFgetc(kv.first, kv.second, kv.first);
+            }
+            for (auto &kv : MI.mapFreadID)
+            {
+                InlineHookFread(kv.first, kv.second, GetInsertPointAfterCall(kv.first));
+            }
+            for (auto &kv : MI.mapOstreamID)
+            {
+                InlineHookOstream(kv.first, kv.second, kv.first);
+            }
+            for (auto &kv : MI.mapIOReadID)
+            {
+                InlineHookIORead(kv.first, kv.second, GetInsertPointAfterCall(kv.first));
+            }
+        }
+
+        /// Append {IO_BYTES, 0, IO_SUMMARY} if IO_BYTES is not 0, and reset IO_BYTES.
+        /// The IO hooks only count bytes, a byte-at-a-time fgetc loop logs one record per sample instead of one per call.
+        void InlineFlushIO(llvm::Instruction *InsertBefore);
+
+        /// Flush IO_BYTES on the exits of pLoop (edges from pLoop only), so that the bytes read by a sampled
+        /// execution do not wait for the next delimiter
+        void InlineFlushIOAtLoopExits(llvm::Loop *pLoop);
+
+        /// Flush IO_BYTES, then append the final record {numGlobalCost, 0, 0}
+        void InlineOutputCost(llvm::Instruction *InsertBefore);
+
+        /// Init the buffer and SAMPLE_RATE (and the sample control) at the entry of funcName,
+        /// output cost and finalize at its exits
+        void InstrumentMain(llvm::StringRef funcName);
+
+    protected:
+        /// Append one record in the compact layout
+        void InlineSetCompactRecord(llvm::Value *address, llvm::Value *length, llvm::Value *id, llvm::Instruction *InsertBefore,
+                                    llvm::Value *keep = nullptr);
+
+        /// IO_BYTES += bytes (i64)
+        void InlineAddIOBytes(llvm::Value *bytes, llvm::Instruction *InsertBefore);
+
+        /// The instruction after pCall, the first of the normal destination of an invoke
+        /// (a new block on the normal edge if the destination has other predecessors)
+        llvm::Instruction *GetInsertPointAfterCall(llvm::Instruction *pCall);
+
+        /// Let threads created by the program open their own buffers (PerThreadSink)
+        void RedirectThreadCreation();
+
+        /// Threads started elsewhere (another library, std::thread in another module) have no buffer:
+        /// every function writing records but pMain opens it at its entry if needed (PerThreadSink)
+        void GuardThreadBuffers(llvm::Function *pMain);
+
+        /// Sampling counters are thread local with the per-thread sink, so are the counters a pass adds
+        llvm::GlobalValue::ThreadLocalMode GetCounterTLSMode() const;
+
+        llvm::Module *pModule;
+        RecordFormat Format;
+        RecordSink Sink;
+        /// -sample-control: InstrumentMain hands SAMPLE_RATE and SAMPLE_ENABLED to the runtime
+        bool bSampleControl;
+
+        // Type
+        llvm::Type *VoidType;
+        llvm::IntegerType *LongType;
+        llvm::IntegerType *IntType;
+        llvm::IntegerType *CharType;
+        llvm::PointerType *CharStarType;
+        llvm::StructType *struct_stMemRecord;
+        llvm::StructType *struct_stCompactRecord;
+        llvm::StructType *struct_stCompactExtRecord;
+
+        // Global Variable
+        llvm::GlobalVariable *SAMPLE_RATE;
+        // 0 while sampling is switched off at runtime, nullptr without -sample-control
+        llvm::GlobalVariable *SAMPLE_ENABLED;
+        llvm::GlobalVariable *numGlobalCounter;
+        llvm::GlobalVariable *numGlobalCost;
+        llvm::GlobalVariable *Record_CPI;
+        llvm::GlobalVariable *pcBuffer_CPI;
+        llvm::GlobalVariable *iBufferIndex_CPI;
+        // thread local long IO_BYTES = 0; input bytes not flushed yet
+        llvm::GlobalVariable *IO_BYTES;
+
+        // Function
+        // sample_rate_str = getenv("SAMPLE_RATE");
+        llvm::Function *getenv;
+        // sample_rate = atoi(sample_rate_str)
+        llvm::Function *function_atoi;
+        // random_gen
+        llvm::Function *geo;
+        // rate = SampleBegin(SAMPLE_RATE) at the start of a sampled execution, adapted to the overhead budget
+        llvm::Function *SampleBegin;
+        // SampleEnd() at the exits of a sampled execution
+        llvm::Function *SampleEnd;
+        // InitSampleControl(&SAMPLE_RATE, &SAMPLE_ENABLED) installs the signal handlers
+        llvm::Function *InitSampleControl;
+        // Init the trace buffer at the entry of main function.
+        llvm::Function *InitMemHooks;
+        // Finalize the trace buffer at the return/exit of main function.
+        llvm::Function *FinalizeMemHooks;
+        // InitForeignThreadMemHooks() opens the buffer of a thread not created through pthread_create_CPI
+        llvm::Function *InitForeignThreadMemHooks = nullptr;
+        // the functions InlineSetRecord has written records into
+        std::set<llvm::Function *> setRecordFuncs;
+
+        // Constant
+        llvm::ConstantInt *ConstantLong0;
+        llvm::ConstantInt *ConstantLong1;
+        llvm::ConstantInt *ConstantInt0;
+        llvm::ConstantInt *ConstantIntN1;
+        llvm::ConstantInt *ConstantInt1;
+        llvm::ConstantInt *ConstantInt2;
+        llvm::ConstantInt *ConstantInt3;
+        llvm::ConstantInt *ConstantInt4;
+        llvm::ConstantInt *ConstantInt5;
+        llvm::ConstantInt *ConstantDelimit;
+        llvm::ConstantInt *ConstantLoopBegin;
+        llvm::ConstantInt *ConstantLoopEnd;
+        llvm::ConstantInt *ConstantLoopStride;
+        llvm::ConstantInt *ConstantLoopNegativeStride;
+        llvm::ConstantInt *ConstantLoopAffine;
+        llvm::ConstantInt *ConstantSampleWeight;
+        llvm::ConstantInt *ConstantLoopLinkedList;
+        llvm::ConstantInt *ConstantIOSummary;
+        llvm::ConstantInt *ConstantLong12;
+        llvm::ConstantInt *ConstantLong16;
+        llvm::ConstantPointerNull *ConstantNULL;
+        llvm::Constant *SAMPLE_RATE_ptr;
+        // "" in place of the NULL line of fgets at EOF
+        llvm::Constant *EmptyStr_ptr;
+    };
+} // namespace common
+
+#endif //PRODUCTIONRUN_RECORDEMITTER_H
@@ -5,6 +5,8 @@
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instruction.h"
+#include "Common/IDIndex.h"
+#include <map>
 #include <set>
 
 namespace common
@@ -27,6 +29,11 @@ namespace common
 
     /// Search Instructioin by ID
     Instruction *SearchInstructionByID(std::set<BasicBlock *> &BBs, unsigned InstID);
+
+    /// Map the <InstID, FuncIDs> of the resolved indirect calls (see parseIndirectCalls) to the call sites and
+    /// their defined callees in the indexed module
+    void SearchIndirectCallees(const IDIndex &Index, const std::map<unsigned, std::set<unsigned>> &mapIndirectCalls,
+                               std::map<Instruction *, std::set<Function *>> &mapIndirectCallees);
 } // namespace common
 
 #endif //PRODUCTIONRUN_SEARCHHELPER_H
\ No newline at end of file
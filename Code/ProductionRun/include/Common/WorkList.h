@@ -1,12 +1,17 @@
+#ifndef PRODUCTIONRUN_WORKLIST_H
+#define PRODUCTIONRUN_WORKLIST_H
+
 #include <vector>
-#include <set>
-#include <algorithm>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SetVector.h"
 #include "optional.h"
 
+// LIFO worklist, an element is pushed at most once
 template<typename T>
 class WorkList {
     std::vector<T> stack;
-    std::set<T> set;
+    llvm::DenseSet<T> set;
 public:
     bool push(T elem);
     std::experimental::optional<T> pop();
@@ -14,8 +19,7 @@ public:
 
 template<typename T>
 bool WorkList<T>::push(T elem) {
-    auto ret = this->set.insert(elem);
-    if (*ret.first) {
+    if (this->set.insert(elem).second) {
         this->stack.push_back(elem);
         return true;
     } else {
@@ -33,20 +37,20 @@ std::experimental::optional<T> WorkList<T>::pop() {
     return std::experimental::optional<T>(ret);
 }
 
+// LIFO worklist, an element is pushed at most once, getSet() keeps every pushed element in push order
 template<typename T>
 class OrdWorkList {
     std::vector<T> stack;
-    std::vector<T> set;
+    llvm::SetVector<T, std::vector<T>, llvm::DenseSet<T>> set;
 public:
     bool push(T elem);
     std::experimental::optional<T> pop();
-    std::vector<T> getSet();
+    llvm::ArrayRef<T> getSet() const;
 };
 
 template<typename T>
 bool OrdWorkList<T>::push(T elem) {
-    if (std::find(this->set.begin(), this->set.end(), elem) == set.end()) {
-        this->set.push_back(elem);
+    if (this->set.insert(elem)) {
         this->stack.push_back(elem);
         return true;
     } else {
@@ -65,6 +69,8 @@ std::experimental::optional<T> OrdWorkList<T>::pop() {
 }
 
 template<typename T>
-std::vector<T> OrdWorkList<T>::getSet() {
-    return this->set;
+llvm::ArrayRef<T> OrdWorkList<T>::getSet() const {
+    return this->set.getArrayRef();
 }
+
+#endif //PRODUCTIONRUN_WORKLIST_H
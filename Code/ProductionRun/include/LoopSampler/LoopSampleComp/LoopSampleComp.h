@@ -27,10 +27,22 @@ namespace loopsampler
         /// Create If-Else blocks and return Preheader of the instrumented loop (Else block)
         llvm::BasicBlock *CreateIfElseBlock(llvm::Loop *pInnerLoop, llvm::BasicBlock *pClonedLoopHeader);
 
+        /// Draw the counter of the sampled execution started in pElseBody at rate = SampleBegin(SAMPLE_RATE),
+        /// and call SampleEnd on the exits of pInnerLoop (the instrumented loop). Return the rate.
+        llvm::Value *AdaptSampleRate(llvm::Loop *pInnerLoop, llvm::BasicBlock *pElseBody, llvm::Function *SampleBegin,
+                                     llvm::Function *SampleEnd);
+
+        /// Take the sampled path in pElseBody only while SAMPLE_ENABLED is set, otherwise run the cloned loop
+        /// and keep the counter, so the first execution after sampling is switched back on is sampled
+        void GuardSampledPath(llvm::BasicBlock *pElseBody, llvm::BasicBlock *pClonedLoopHeader,
+                              llvm::GlobalVariable *SAMPLE_ENABLED);
+
         void RemapInstruction(llvm::Instruction *I, llvm::ValueToValueMapTy &VMap);
 
         void CloneFunctions(std::set<llvm::Function *> &setFunc, llvm::ValueToValueMapTy &originClonedMapping);
 
+        /// Redirect the cloned call sites to the cloned callees.
+        /// An indirect call site is promoted to a guarded direct call: if (fp == callee) callee.CPI(...) else fp(...)
         bool RemapFunctionCalls(const std::set<llvm::Function *> &setFunc,
                                 std::map<llvm::Function *, std::set<llvm::Instruction *>> &funcCallSiteMapping,
                                 llvm::ValueToValueMapTy &originClonedMapping);
@@ -3,6 +3,7 @@
 
 #include "LoopSampler/LoopBaseInstrumentor/LoopBaseInstrumentor.h"
 #include "LoopSampler/LoopSampleComp/LoopSampleComp.h"
+#include "llvm/IR/DebugLoc.h"
 //#include <llvm/Pass.h>
 //#include <llvm/Analysis/LoopInfo.h>
 //#include <llvm/Analysis/AliasAnalysis.h>
@@ -13,11 +14,44 @@
 //#include "Common/MonitorRWInsts.h"
 
 namespace loopsampler {
+/// A loop selected in whole-program mode, identified by its header
+struct SelectedLoop
+{
+    llvm::BasicBlock *pHeader;
+    /// Blocks of the loop, to keep a loop nested in a selected one out of the selection
+    std::set<llvm::BasicBlock *> setBlocks;
+    unsigned uLoopID;
+    unsigned long uCost;
+    llvm::DebugLoc StartLoc;
+    /// Executions of its hottest profiled line, 0 without -loopProfile
+    unsigned long uHotness;
+    /// Instructions in the loop, and instructions cloned for it (shared callees counted once)
+    unsigned long uSize;
+    unsigned long uGrowth;
+    unsigned uMonitored;
+    std::set<llvm::Function *> setCallees;
+};
+
 struct LoopSampleInstrumentor : public LoopBaseInstrumentor
 {
     static char ID;
 
+    void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
+
     bool runOnModule(llvm::Module &M) override final;
+
+private:
+    /// -summarizeInner: the loop is sampled as a whole, the affine accesses of its inner loops are removed from MI
+    /// and logged once per inner loop execution (LOOP_AFFINE). Call it after cloning: the summaries are inserted
+    /// into the sampled copy only. Return the number of summarized accesses.
+    unsigned SummarizeInnerLoops(llvm::BasicBlock *pHeader, common::MonitoredRWInsts &MI);
+
+    /// Instrument every selected loop with its own sampling counter, tag its records with its loop ID
+    bool InstrumentWholeProgram(llvm::Module &M);
+
+    /// Collect the candidate loops (all loops or those in the loop list) whose static cost reaches the threshold,
+    /// pick those to clone within the code-growth budget, hottest first with a profile
+    void SelectLoops(llvm::Module &M, std::vector<SelectedLoop> &vecSelected);
 };
 }
 
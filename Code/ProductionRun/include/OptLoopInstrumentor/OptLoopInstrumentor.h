@@ -14,6 +14,7 @@
 
 #include "Common/LocateInstrument.h"
 #include "Common/MonitorRWInsts.h"
+#include "Common/RecordEmitter.h"
 
 using namespace llvm;
 
@@ -28,7 +29,7 @@ enum class LOOP_TYPE {
     LINKEDLIST = 2
 };
 
-struct OptLoopInstrumentor : public ModulePass {
+struct OptLoopInstrumentor : public ModulePass, public common::RecordEmitter {
 
     static char ID;
 
@@ -40,19 +41,6 @@ struct OptLoopInstrumentor : public ModulePass {
 
 private:
 
-    // Setup
-    void SetupInit(Module &M);
-
-    void SetupTypes();
-
-    void SetupStructs();
-
-    void SetupConstants();
-
-    void SetupGlobals();
-
-    void SetupFunctions();
-
     // Search and optimize R/W Insts
     LOOP_TYPE getArrayListInsts(Loop *pLoop, MonitoredRWInsts &MI);
 
@@ -94,14 +82,10 @@ private:
     void CreateIfElseIfBlock(Loop *pInnerLoop, std::vector<BasicBlock *> &vecAdded);
 
     // Instrument
-    void InstrumentMonitoredInsts(MonitoredRWInsts &MI);
-
     void HoistOrSinkMonitoredInsts(MonitoredRWInsts &MI, Instruction *InsertBefore);
 
     void InstrumentCallees(std::set<Function *> setOriginFunc, ValueToValueMapTy &originClonedMapping);
 
-    void InstrumentMain(StringRef funcName);
-
     // Inline instrument
     void InlineNumGlobalCost(Loop *pLoop, ValueToValueMapTy &VMap);
 
@@ -109,26 +93,6 @@ private:
 
     void InlineGlobalCostForCallee(Function * pFunction);
 
-    void InlineSetRecord(Value *address, Value *length, Value *id, Instruction *InsertBefore);
-
-    void InlineHookDelimit(Instruction *InsertBefore);
-
-    void InlineHookLoad(LoadInst *pLoad, unsigned uID, Instruction *InsertBefore);
-
-    void InlineHookStore(StoreInst *pStore, unsigned uID, Instruction *InsertBefore);
-
-    void InlineHookMemSet(MemSetInst *pMemSet, unsigned uID, Instruction *InsertBefore);
-
-    void InlineHookMemTransfer(MemTransferInst *pMemTransfer, unsigned uID, Instruction *InsertBefore);
-
-    void InlineHookFgetc(Instruction *pCall, unsigned uID, Instruction *InsertBefore);
-
-    void InlineHookFread(Instruction *pCall, unsigned uID, Instruction *InsertBefore);
-
-    void InlineHookOstream(Instruction *pCall, unsigned uID, Instruction *InsertBefore);
-
-    void InlineOutputCost(Instruction *InsertBefore);
-
     void InlineHookLoopBegin(LoadInst *pLoad, unsigned uID, Instruction *InsertBefore);
 
     void InlineHookLoopEnd(LoadInst *pLoad, unsigned uID, Instruction *InsertBefore);
@@ -137,54 +101,6 @@ private:
 
     void RemapInstruction(Instruction *I, ValueToValueMapTy &VMap);
 
-private:
-
-    Module *pModule;
-    // Type
-    Type *VoidType;
-    IntegerType *LongType;
-    IntegerType *IntType;
-    IntegerType *CharType;
-    PointerType *CharStarType;
-    StructType *struct_stMemRecord;
-
-    // Global Variable
-    GlobalVariable *SAMPLE_RATE;
-    GlobalVariable *numGlobalCounter;
-    GlobalVariable *numGlobalCost;
-    GlobalVariable *Record_CPI;
-    GlobalVariable *pcBuffer_CPI;
-    GlobalVariable *iBufferIndex_CPI;
-
-    // Function
-    // sample_rate_str = getenv("SAMPLE_RATE");
-    Function *getenv;
-    // sample_rate = atoi(sample_rate_str)
-    Function *function_atoi;
-    // random_gen
-    Function *geo;
-    // Init shared memory at the entry of main function.
-    Function *InitMemHooks;
-    // Finalize shared memory at the return/exit of main function.
-    Function *FinalizeMemHooks;
-
-    // Constant
-    ConstantInt *ConstantLong0;
-    ConstantInt *ConstantLong1;
-    ConstantInt *ConstantInt0;
-    ConstantInt *ConstantIntN1;
-    ConstantInt *ConstantInt1;
-    ConstantInt *ConstantInt2;
-    ConstantInt *ConstantInt3;
-    ConstantInt *ConstantInt4;
-    ConstantInt *ConstantInt5;
-    ConstantInt *ConstantDelimit;
-    ConstantInt *ConstantLoopBegin;
-    ConstantInt *ConstantLoopEnd;
-    ConstantInt *ConstantLong16;
-    ConstantPointerNull *ConstantNULL;
-    Constant *SAMPLE_RATE_ptr;
-
 };
 
 
@@ -0,0 +1,250 @@
+#include "Common/AffineAccess.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/MemoryLocation.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <set>
+
+using namespace llvm;
+
+namespace common
+{
+    struct PointerAccess
+    {
+        Instruction *pInst;
+        const SCEV *Ptr;
+        bool isStore;
+        bool isAffine;
+    };
+
+    /// Return true if I is a simple load/store at {Start,+,Stride}<pLoop> executed once per iteration
+    static bool isAffineAccess(Instruction *I, const SCEV *Ptr, Loop *pLoop, ScalarEvolution &SE,
+                               DominatorTree &DT)
+    {
+        if (LoadInst *pLoad = dyn_cast<LoadInst>(I))
+        {
+            if (!pLoad->isSimple())
+            {
+                return false;
+            }
+        }
+        else if (StoreInst *pStore = dyn_cast<StoreInst>(I))
+        {
+            if (!pStore->isSimple())
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+
+        if (!DT.dominates(I->getParent(), pLoop->getLoopLatch()))
+        {
+            return false;
+        }
+
+        const SCEVAddRecExpr *AR = dyn_cast<SCEVAddRecExpr>(Ptr);
+        if (!AR || AR->getLoop() != pLoop || !AR->isAffine())
+        {
+            return false;
+        }
+
+        const SCEVConstant *Step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+        if (!Step || Step->getValue()->isZero())
+        {
+            return false;
+        }
+        int64_t Stride = Step->getAPInt().getSExtValue();
+        if (Stride <= INT_MIN || Stride >= INT_MAX)
+        {
+            return false;
+        }
+
+        return isSafeToExpand(AR->getStart(), SE);
+    }
+
+    bool HasCallInLoop(Loop *pLoop)
+    {
+        for (BasicBlock *BB : pLoop->blocks())
+        {
+            for (Instruction &II : *BB)
+            {
+                if ((isa<CallInst>(&II) || isa<InvokeInst>(&II)) && !isa<IntrinsicInst>(&II))
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    std::unique_ptr<ScalarEvolution> BuildScalarEvolution(Pass &P, Function &F, DominatorTree &DT, LoopInfo &LI)
+    {
+        TargetLibraryInfo &TLI = P.getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
+        AssumptionCache &AC = P.getAnalysis<AssumptionCacheTracker>().getAssumptionCache(F);
+        return std::unique_ptr<ScalarEvolution>(new ScalarEvolution(F, TLI, AC, DT, LI));
+    }
+
+    const SCEV *CollectAffineAccesses(Loop *pLoop, ScalarEvolution &SE, DominatorTree &DT, AliasAnalysis &AA,
+                                      std::vector<AffineAccess> &vecAffine)
+    {
+        BasicBlock *pLatch = pLoop->getLoopLatch();
+        if (!pLoop->getLoopPreheader() || !pLatch || pLoop->getExitingBlock() != pLatch ||
+            !pLoop->getUniqueExitBlock() || !pLoop->hasDedicatedExits())
+        {
+            return nullptr;
+        }
+
+        // Every block dominating the latch runs BackedgeTakenCount + 1 times
+        const SCEV *BTC = SE.getBackedgeTakenCount(pLoop);
+        if (isa<SCEVCouldNotCompute>(BTC))
+        {
+            return nullptr;
+        }
+        Type *LongType = Type::getInt64Ty(pLoop->getHeader()->getContext());
+        const SCEV *TripCount = SE.getAddExpr(SE.getTruncateOrZeroExtend(BTC, LongType), SE.getOne(LongType));
+        if (!isSafeToExpand(TripCount, SE))
+        {
+            return nullptr;
+        }
+
+        // Group every memory access in the loop by its base pointer
+        std::map<const SCEV *, std::vector<PointerAccess>> mapBaseAccess;
+        auto addAccess = [&](Instruction *I, Value *Ptr, bool isStore) {
+            const SCEV *PtrSCEV = SE.getSCEV(Ptr);
+            bool isAffine = isAffineAccess(I, PtrSCEV, pLoop, SE, DT);
+            mapBaseAccess[SE.getPointerBase(PtrSCEV)].push_back({I, PtrSCEV, isStore, isAffine});
+        };
+        for (BasicBlock *BB : pLoop->blocks())
+        {
+            for (Instruction &II : *BB)
+            {
+                if (LoadInst *pLoad = dyn_cast<LoadInst>(&II))
+                {
+                    addAccess(pLoad, pLoad->getPointerOperand(), false);
+                }
+                else if (StoreInst *pStore = dyn_cast<StoreInst>(&II))
+                {
+                    addAccess(pStore, pStore->getPointerOperand(), true);
+                }
+                else if (MemTransferInst *pMemTransfer = dyn_cast<MemTransferInst>(&II))
+                {
+                    addAccess(pMemTransfer, pMemTransfer->getSource(), false);
+                    addAccess(pMemTransfer, pMemTransfer->getDest(), true);
+                }
+                else if (MemSetInst *pMemSet = dyn_cast<MemSetInst>(&II))
+                {
+                    addAccess(pMemSet, pMemSet->getDest(), true);
+                }
+            }
+        }
+
+        // Bases are checked one by one below, so no address may be reached from two of them: a read of p[i] and a
+        // write of q[i] with q = p + 1 would both qualify, and the summaries would reorder their first accesses.
+        if (mapBaseAccess.size() > 1)
+        {
+            std::vector<const Value *> vecBases;
+            for (auto &kv : mapBaseAccess)
+            {
+                const SCEVUnknown *Base = dyn_cast<SCEVUnknown>(kv.first);
+                if (!Base)
+                {
+                    return TripCount;
+                }
+                vecBases.push_back(Base->getValue());
+            }
+            for (size_t i = 0; i < vecBases.size(); ++i)
+            {
+                for (size_t j = i + 1; j < vecBases.size(); ++j)
+                {
+                    if (AA.alias(MemoryLocation(vecBases[i]), MemoryLocation(vecBases[j])) != NoAlias)
+                    {
+                        return TripCount;
+                    }
+                }
+            }
+        }
+
+        // Summaries are appended at the loop exit, so the first load/store of an address must not depend on
+        // the interleaving of iterations: a base qualifies if all its accesses are affine and are either of
+        // one kind (all loads or all stores) or at the same address in each iteration.
+        std::set<Instruction *> setSummarized;
+        for (auto &kv : mapBaseAccess)
+        {
+            bool allAffine = true;
+            bool sameKind = true;
+            bool sameAddress = true;
+            for (PointerAccess &PA : kv.second)
+            {
+                allAffine &= PA.isAffine;
+                sameKind &= PA.isStore == kv.second.front().isStore;
+                sameAddress &= PA.Ptr == kv.second.front().Ptr;
+            }
+            if (allAffine && (sameKind || sameAddress))
+            {
+                for (PointerAccess &PA : kv.second)
+                {
+                    setSummarized.insert(PA.pInst);
+                }
+            }
+        }
+        if (setSummarized.empty())
+        {
+            return TripCount;
+        }
+
+        // Blocks dominating the latch form a chain, visit them in program order
+        std::vector<BasicBlock *> vecChain;
+        for (BasicBlock *BB : pLoop->blocks())
+        {
+            if (DT.dominates(BB, pLatch))
+            {
+                vecChain.push_back(BB);
+            }
+        }
+        std::sort(vecChain.begin(), vecChain.end(), [&](BasicBlock *A, BasicBlock *B) {
+            return A != B && DT.dominates(A, B);
+        });
+
+        const DataLayout &DL = pLoop->getHeader()->getModule()->getDataLayout();
+        for (BasicBlock *BB : vecChain)
+        {
+            for (Instruction &II : *BB)
+            {
+                if (setSummarized.find(&II) == setSummarized.end())
+                {
+                    continue;
+                }
+                AffineAccess Access;
+                Access.pInst = &II;
+                if (LoadInst *pLoad = dyn_cast<LoadInst>(&II))
+                {
+                    Access.isStore = false;
+                    Access.ElemSize = DL.getTypeAllocSize(pLoad->getType());
+                    Access.Start = SE.getSCEV(pLoad->getPointerOperand());
+                }
+                else
+                {
+                    StoreInst *pStore = cast<StoreInst>(&II);
+                    Access.isStore = true;
+                    Access.ElemSize = DL.getTypeAllocSize(pStore->getValueOperand()->getType());
+                    Access.Start = SE.getSCEV(pStore->getPointerOperand());
+                }
+                const SCEVAddRecExpr *AR = cast<SCEVAddRecExpr>(Access.Start);
+                Access.Start = AR->getStart();
+                Access.Stride = (int)cast<SCEVConstant>(AR->getStepRecurrence(SE))->getAPInt().getSExtValue();
+                vecAffine.push_back(Access);
+            }
+        }
+
+        return TripCount;
+    }
+} // namespace common
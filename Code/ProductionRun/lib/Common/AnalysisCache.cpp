@@ -0,0 +1,288 @@
+#include "Common/AnalysisCache.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugLoc.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+#include "Common/IDHelper.h"
+#include <fstream>
+#include <sstream>
+
+using namespace llvm;
+
+namespace common
+{
+    /// FNV-1a: llvm::hash_code is only guaranteed stable within one run
+    struct StableHasher
+    {
+        uint64_t Hash = 14695981039346656037ULL;
+
+        void addByte(unsigned char c)
+        {
+            Hash ^= c;
+            Hash *= 1099511628211ULL;
+        }
+
+        void add(uint64_t V)
+        {
+            for (unsigned i = 0; i < 8; ++i)
+            {
+                addByte((V >> (i * 8)) & 0xff);
+            }
+        }
+
+        void add(StringRef S)
+        {
+            add(S.size());
+            for (char c : S)
+            {
+                addByte(c);
+            }
+        }
+
+        void add(const APInt &V)
+        {
+            add(V.getBitWidth());
+            for (unsigned i = 0; i < V.getNumWords(); ++i)
+            {
+                add(V.getRawData()[i]);
+            }
+        }
+    };
+
+    static void hashType(StableHasher &H, Type *T)
+    {
+        H.add(T->getTypeID());
+        if (IntegerType *IT = dyn_cast<IntegerType>(T))
+        {
+            H.add(IT->getBitWidth());
+            return;
+        }
+        if (StructType *ST = dyn_cast<StructType>(T))
+        {
+            H.add(ST->getNumElements());
+            // Named structs may be recursive
+            if (ST->hasName())
+            {
+                H.add(ST->getName());
+                return;
+            }
+        }
+        else if (T->isArrayTy())
+        {
+            H.add(T->getArrayNumElements());
+        }
+        else if (T->isVectorTy())
+        {
+            H.add(T->getVectorNumElements());
+        }
+        for (Type *Sub : T->subtypes())
+        {
+            hashType(H, Sub);
+        }
+    }
+
+    /// Arguments, blocks and instructions of the function by order of first appearance,
+    /// constants and globals by content and name
+    static void hashValue(StableHasher &H, Value *V, DenseMap<Value *, unsigned> &mapNumber)
+    {
+        if (isa<Argument>(V) || isa<BasicBlock>(V) || isa<Instruction>(V))
+        {
+            auto It = mapNumber.insert({V, mapNumber.size()}).first;
+            H.add(1);
+            H.add(It->second);
+            return;
+        }
+        H.add(V->getValueID());
+        hashType(H, V->getType());
+        if (GlobalValue *GV = dyn_cast<GlobalValue>(V))
+        {
+            H.add(GV->getName());
+        }
+        else if (ConstantInt *CI = dyn_cast<ConstantInt>(V))
+        {
+            H.add(CI->getValue());
+        }
+        else if (ConstantFP *CFP = dyn_cast<ConstantFP>(V))
+        {
+            H.add(CFP->getValueAPF().bitcastToAPInt());
+        }
+        else if (ConstantDataSequential *CDS = dyn_cast<ConstantDataSequential>(V))
+        {
+            H.add(CDS->getRawDataValues());
+        }
+        else if (ConstantExpr *CE = dyn_cast<ConstantExpr>(V))
+        {
+            H.add(CE->getOpcode());
+            for (Value *Op : CE->operands())
+            {
+                hashValue(H, Op, mapNumber);
+            }
+        }
+        else if (Constant *C = dyn_cast<Constant>(V))
+        {
+            for (Value *Op : C->operands())
+            {
+                hashValue(H, Op, mapNumber);
+            }
+        }
+        else if (InlineAsm *IA = dyn_cast<InlineAsm>(V))
+        {
+            H.add(IA->getAsmString());
+            H.add(IA->getConstraintString());
+        }
+    }
+
+    uint64_t AnalysisCache::hashFunction(Function &F)
+    {
+        StableHasher H;
+        H.add(F.getName());
+        H.add(GetFunctionID(&F));
+        hashType(H, F.getFunctionType());
+
+        // One walk: a value is numbered where it is first defined or used, definitions hash their number too
+        DenseMap<Value *, unsigned> mapNumber;
+        for (Argument &A : F.args())
+        {
+            hashValue(H, &A, mapNumber);
+        }
+        for (BasicBlock &B : F)
+        {
+            hashValue(H, &B, mapNumber);
+            H.add(GetBasicBlockID(&B));
+            H.add(B.hasAddressTaken());
+            H.add(B.size());
+            for (Instruction &I : B)
+            {
+                hashValue(H, &I, mapNumber);
+                H.add(I.getOpcode());
+                hashType(H, I.getType());
+                H.add(GetInstructionID(&I));
+                if (CmpInst *pCmp = dyn_cast<CmpInst>(&I))
+                {
+                    H.add(pCmp->getPredicate());
+                }
+                else if (AllocaInst *pAlloca = dyn_cast<AllocaInst>(&I))
+                {
+                    hashType(H, pAlloca->getAllocatedType());
+                }
+                else if (GetElementPtrInst *pGEP = dyn_cast<GetElementPtrInst>(&I))
+                {
+                    hashType(H, pGEP->getSourceElementType());
+                }
+                H.add(I.getNumOperands());
+                for (Value *Op : I.operands())
+                {
+                    hashValue(H, Op, mapNumber);
+                }
+                const DebugLoc &Loc = I.getDebugLoc();
+                H.add(Loc ? Loc.getLine() : 0);
+                H.add(Loc ? Loc.getCol() : 0);
+                H.add(I.getMetadata(LLVMContext::MD_loop) != nullptr);
+            }
+        }
+        return H.Hash;
+    }
+
+    uint64_t AnalysisCache::getHash(Function &F)
+    {
+        auto It = mapHashes.find(&F);
+        if (It != mapHashes.end())
+        {
+            return It->second;
+        }
+        uint64_t Hash = hashFunction(F);
+        mapHashes[&F] = Hash;
+        return Hash;
+    }
+
+    /// One "<FuncName> <Hash> <Key> <N> <Value_1> ... <Value_N>" per line
+    bool AnalysisCache::load(const std::string &strPath)
+    {
+        mapEntries.clear();
+        std::ifstream ifsCache(strPath);
+        if (!ifsCache.is_open())
+        {
+            return true;
+        }
+        std::string strLine;
+        while (std::getline(ifsCache, strLine))
+        {
+            std::istringstream issLine(strLine);
+            std::string strFunc;
+            uint64_t Hash;
+            std::string strKey;
+            size_t uNum;
+            if (!(issLine >> strFunc >> Hash >> strKey >> uNum))
+            {
+                continue;
+            }
+            std::vector<unsigned long> vecValues(uNum);
+            for (unsigned long &Value : vecValues)
+            {
+                issLine >> Value;
+            }
+            if (!issLine)
+            {
+                continue;
+            }
+            FuncEntry &Entry = mapEntries[strFunc];
+            if (Entry.Hash != Hash)
+            {
+                Entry.Hash = Hash;
+                Entry.mapValues.clear();
+            }
+            Entry.mapValues[strKey] = std::move(vecValues);
+        }
+        return true;
+    }
+
+    bool AnalysisCache::save(const std::string &strPath) const
+    {
+        std::ofstream ofsCache(strPath);
+        if (!ofsCache.is_open())
+        {
+            return false;
+        }
+        for (auto &kvFunc : mapEntries)
+        {
+            for (auto &kvValues : kvFunc.second.mapValues)
+            {
+                ofsCache << kvFunc.first << " " << kvFunc.second.Hash << " " << kvValues.first << " "
+                         << kvValues.second.size();
+                for (unsigned long Value : kvValues.second)
+                {
+                    ofsCache << " " << Value;
+                }
+                ofsCache << "\n";
+            }
+        }
+        return (bool)ofsCache;
+    }
+
+    const std::vector<unsigned long> *AnalysisCache::lookup(Function &F, StringRef Key)
+    {
+        auto itFunc = mapEntries.find(F.getName().str());
+        if (itFunc == mapEntries.end() || itFunc->second.Hash != getHash(F))
+        {
+            return nullptr;
+        }
+        auto itValues = itFunc->second.mapValues.find(Key.str());
+        if (itValues == itFunc->second.mapValues.end())
+        {
+            return nullptr;
+        }
+        return &itValues->second;
+    }
+
+    void AnalysisCache::store(Function &F, StringRef Key, std::vector<unsigned long> vecValues)
+    {
+        uint64_t Hash = getHash(F);
+        FuncEntry &Entry = mapEntries[F.getName().str()];
+        if (Entry.Hash != Hash)
+        {
+            Entry.Hash = Hash;
+            Entry.mapValues.clear();
+        }
+        Entry.mapValues[Key.str()] = std::move(vecValues);
+    }
+} // namespace common
@@ -86,12 +86,16 @@ namespace common
         {
             return INVALID_ID;
         }
-        BasicBlock *LoopHeader = L->getHeader();
-        if (!LoopHeader)
+        return GetLoopHeaderID(L->getHeader());
+    }
+
+    unsigned GetLoopHeaderID(BasicBlock *B)
+    {
+        if (!B)
         {
             return INVALID_ID;
         }
-        for (Instruction &I : *LoopHeader)
+        for (Instruction &I : *B)
         {
             unsigned LoopID = GetIDHelper(&I, "loop_id");
             if (LoopID != INVALID_ID)
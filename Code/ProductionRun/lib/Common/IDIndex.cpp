@@ -0,0 +1,169 @@
+#include "Common/IDIndex.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "Common/Constants.h"
+#include "Common/IDHelper.h"
+#include <algorithm>
+#include <map>
+#include <utility>
+
+using namespace llvm;
+
+namespace common
+{
+    void IDIndex::build(Module &M)
+    {
+        mapFunc.clear();
+        mapBB.clear();
+        mapInst.clear();
+        mapLoopHeader.clear();
+        vecBounds.clear();
+        mapLineBBs.clear();
+
+        for (Function &F : M)
+        {
+            if (F.isDeclaration())
+            {
+                continue;
+            }
+            unsigned FuncID = GetFunctionID(&F);
+            if (FuncID != INVALID_ID)
+            {
+                mapFunc[FuncID] = &F;
+            }
+            // FileName: <StartLine, EndLine>
+            std::map<StringRef, std::pair<unsigned, unsigned>> FunctionBounds;
+            auto &mapLine = mapLineBBs[&F];
+            for (BasicBlock &B : F)
+            {
+                unsigned BBID = GetBasicBlockID(&B);
+                if (BBID != INVALID_ID)
+                {
+                    mapBB[BBID] = &B;
+                }
+                unsigned LoopID = GetLoopHeaderID(&B);
+                if (LoopID != INVALID_ID)
+                {
+                    mapLoopHeader[LoopID] = &B;
+                }
+                for (Instruction &I : B)
+                {
+                    unsigned InstID = GetInstructionID(&I);
+                    if (InstID != INVALID_ID)
+                    {
+                        mapInst[InstID] = &I;
+                    }
+                    const DILocation *DIL = I.getDebugLoc();
+                    if (!DIL)
+                    {
+                        continue;
+                    }
+                    unsigned CurrLineNo = DIL->getLine();
+                    auto &vecBBs = mapLine[CurrLineNo];
+                    if (vecBBs.empty() || vecBBs.back() != &B)
+                    {
+                        vecBBs.push_back(&B);
+                    }
+                    auto It = FunctionBounds.find(DIL->getFilename());
+                    if (It == FunctionBounds.end())
+                    {
+                        FunctionBounds[DIL->getFilename()] = std::make_pair(CurrLineNo, CurrLineNo);
+                    }
+                    else
+                    {
+                        It->second.first = std::min(It->second.first, CurrLineNo);
+                        It->second.second = std::max(It->second.second, CurrLineNo);
+                    }
+                }
+            }
+            for (const auto &kv : FunctionBounds)
+            {
+                vecBounds.push_back({&F, kv.first, kv.second.first, kv.second.second});
+            }
+        }
+    }
+
+    Function *IDIndex::getFunction(unsigned FuncID) const
+    {
+        return mapFunc.lookup(FuncID);
+    }
+
+    BasicBlock *IDIndex::getBasicBlock(unsigned BBID) const
+    {
+        return mapBB.lookup(BBID);
+    }
+
+    Instruction *IDIndex::getInstruction(unsigned InstID) const
+    {
+        return mapInst.lookup(InstID);
+    }
+
+    BasicBlock *IDIndex::getLoopHeader(unsigned LoopID) const
+    {
+        return mapLoopHeader.lookup(LoopID);
+    }
+
+    Function *IDIndex::searchFunction(const char *FileName, const char *FunctionName, unsigned LineNo) const
+    {
+        for (const FunctionBound &FB : vecBounds)
+        {
+            if (FB.StartLine <= LineNo && LineNo <= FB.EndLine && FB.FileName.contains(FileName) &&
+                FB.F->getName().contains(FunctionName))
+            {
+                return FB.F;
+            }
+        }
+        return nullptr;
+    }
+
+    void IDIndex::searchBasicBlocks(Function *F, unsigned LineNo, std::set<BasicBlock *> &BBs) const
+    {
+        auto itFunc = mapLineBBs.find(F);
+        if (itFunc == mapLineBBs.end())
+        {
+            return;
+        }
+        auto itLine = itFunc->second.find(LineNo);
+        if (itLine == itFunc->second.end())
+        {
+            return;
+        }
+        BBs.insert(itLine->second.begin(), itLine->second.end());
+    }
+
+    Loop *IDIndex::searchLoop(Function *F, LoopInfo *LPI, unsigned LineNo) const
+    {
+        std::set<BasicBlock *> BBs;
+        searchBasicBlocks(F, LineNo, BBs);
+
+        unsigned Depth = 0;
+        BasicBlock *TargetBB = nullptr;
+        for (BasicBlock *BB : BBs)
+        {
+            if (LPI->getLoopDepth(BB) > Depth)
+            {
+                Depth = LPI->getLoopDepth(BB);
+                TargetBB = BB;
+            }
+        }
+
+        if (!TargetBB)
+        {
+            // No block on the line, take the only loop of F
+            std::set<Loop *> Loops;
+            for (BasicBlock &B : *F)
+            {
+                if (LPI->getLoopDepth(&B) > 0)
+                {
+                    Loops.insert(LPI->getLoopFor(&B));
+                }
+            }
+            if (Loops.size() == 1)
+            {
+                return *(Loops.begin());
+            }
+            return nullptr;
+        }
+
+        return LPI->getLoopFor(TargetBB);
+    }
+} // namespace common
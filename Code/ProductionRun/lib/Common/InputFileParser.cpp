@@ -1,12 +1,13 @@
 #include "Common/InputFileParser.h"
 
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <string>
 #include "optional.h"
 
 /// isArray
-/// i32 1
+/// i32 1                (i64 ? if the step is not a constant)
 /// 413
 ///  %4 = load i32, i32* %arrayidx3, align 4, !dbg !109, !bb_id !106, !ins_id !112
 ///
@@ -20,15 +21,18 @@ std::experimental::optional<ParsedLoopInfo> parseLoopInfo(const char *fileName)
     fs >> loopType;
     if (loopType == "isArray") {
         std::string _stepType;
-        int step = 0;
+        std::string stepStr;
         unsigned instID = 0;
-        fs >> _stepType >> step;
+        fs >> _stepType >> stepStr;
         fs >> instID;
-        return ParsedLoopInfo { true, step, instID };
+        if (stepStr == "?") {
+            return ParsedLoopInfo { true, false, 0, instID };
+        }
+        return ParsedLoopInfo { true, true, atoi(stepStr.c_str()), instID };
     } else if (loopType == "isLinkedList") {
         unsigned instID = 0;
         fs >> instID;
-        return ParsedLoopInfo { false, 0, instID };
+        return ParsedLoopInfo { false, false, 0, instID };
     } else {
         return {};
     }
@@ -63,3 +67,18 @@ bool parseCallSites(const char *fileName, std::map<unsigned, std::map<unsigned,
     return true;
 }
 
+bool parseIndirectCalls(const char *fileName, std::map<unsigned, std::set<unsigned>>& mapIndirectCalls) {
+    FILE *fp = fopen(fileName, "r");
+    if (!fp) {
+        return false;
+    }
+    unsigned callInst = 0;
+    unsigned callee = 0;
+
+    while (fscanf(fp, "%u %u\n", &callInst, &callee) == 2) {
+        mapIndirectCalls[callInst].insert(callee);
+    }
+    fclose(fp);
+    return true;
+}
+
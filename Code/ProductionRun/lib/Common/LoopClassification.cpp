@@ -0,0 +1,385 @@
+#include "Common/LoopClassification.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Support/raw_ostream.h"
+#include <set>
+#include <utility>
+#include "optional.h"
+#include "Common/IDHelper.h"
+
+using namespace llvm;
+
+namespace common
+{
+    static RegisterPass<LoopClassification> X("loop-classification",
+                                              "classify loops into array/linkedlist, find indvar and stride",
+                                              true, true);
+
+    char LoopClassification::ID = 0;
+
+    /// Decide if a loop is a linkedlist.
+    /// S = phi(load(GEP(S, 0, _))),
+    /// where S is of ptr type to Struct
+    /// and phi is in Loopheader
+    /// and load, GEP are in Loop
+    /// Used after passes loop-simplify and mem2reg
+    static std::experimental::optional<LoadInst *> isLinkedList(Loop *L)
+    {
+        BasicBlock *Header = L->getHeader();
+        std::set<BasicBlock *> LoopBBs(L->getBlocks().begin(), L->getBlocks().end());
+        for (auto &Phi : Header->phis())
+        {
+            if (!Phi.getType()->isPointerTy())
+            {
+                continue;
+            }
+            if (!Phi.getType()->getPointerElementType()->isStructTy())
+            {
+                continue;
+            }
+            for (auto &Incm : Phi.incoming_values())
+            {
+                if (LoadInst *LI = dyn_cast<LoadInst>(Incm))
+                {
+                    if (LoopBBs.find(LI->getParent()) == LoopBBs.end())
+                    {
+                        continue;
+                    }
+                    if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(LI->getPointerOperand()))
+                    {
+                        if (LoopBBs.find(GEP->getParent()) == LoopBBs.end())
+                        {
+                            continue;
+                        }
+                        if (ConstantInt *CI = dyn_cast<ConstantInt>(GEP->getOperand(1)))
+                        {
+                            if (!CI->isZero())
+                            {
+                                continue;
+                            }
+                            if (&Phi == GEP->getPointerOperand())
+                            {
+                                return LI;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return {};
+    }
+
+    /// Decide if a loop is an array which inc/dec index.
+    /// R = phi(add/sub(R, LoopInvar))
+    /// (R = add/sub(R, LoopInvar))?
+    /// (R = castinst(R))?
+    /// load(GEP(_, R)),
+    /// where R is of integer type
+    /// and phi, add/sub, castinst, load, GEP are in loop
+    ///
+    /// Return: Option<(Step, ArrayIdx)>
+    /// 1. Step: LoopInvariant
+    /// 2. ArrayIdx: Load idx ptr to array
+    static std::experimental::optional<std::pair<Value *, LoadInst *>> isIncDecIndex(PHINode &Phi, const std::set<BasicBlock *> &LoopBBs, const Loop *L)
+    {
+        if (!Phi.getType()->isIntegerTy())
+        {
+            return {};
+        }
+
+        Value *Step = nullptr;
+        for (auto &Incm : Phi.incoming_values())
+        {
+            if (Instruction *I = dyn_cast<Instruction>(Incm))
+            {
+                if (LoopBBs.find(I->getParent()) == LoopBBs.end())
+                {
+                    continue;
+                }
+                if (I->getOpcode() != Instruction::Add &&
+                        I->getOpcode() != Instruction::Sub)
+                {
+                    continue;
+                }
+                if (&Phi != I->getOperand(0))
+                {
+                    continue;
+                }
+                if (!L->isLoopInvariant(I->getOperand(1)))
+                {
+                    continue;
+                }
+                Step = I->getOperand(1);
+
+                std::vector<Instruction *> BinOps;
+                BinOps.push_back(&Phi);
+                for (auto *Usr : Phi.users())
+                {
+                    if (Instruction *UsrI = dyn_cast<Instruction>(Usr))
+                    {
+                        if (LoopBBs.find(UsrI->getParent()) == LoopBBs.end())
+                        {
+                            continue;
+                        }
+                        if (I->getOpcode() != Instruction::Add &&
+                                I->getOpcode() != Instruction::Sub)
+                        {
+                            continue;
+                        }
+                        if (!L->isLoopInvariant(I->getOperand(1)))
+                        {
+                            continue;
+                        }
+                        BinOps.push_back(UsrI);
+                    }
+                }
+
+                std::vector<Instruction *> Casts(BinOps.begin(), BinOps.end());
+                for (Instruction *BinOp : BinOps)
+                {
+                    for (auto *Usr : BinOp->users())
+                    {
+                        if (Instruction *UsrI = dyn_cast<Instruction>(Usr))
+                        {
+                            if (LoopBBs.find(UsrI->getParent()) == LoopBBs.end())
+                            {
+                                continue;
+                            }
+                            if (UsrI->isCast())
+                            {
+                                Casts.push_back(UsrI);
+                            }
+                        }
+                    }
+                }
+
+                for (Instruction *Cast : Casts)
+                {
+                    for (User *Usr : Cast->users())
+                    {
+                        if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(Usr))
+                        {
+                            if (LoopBBs.find(GEP->getParent()) == LoopBBs.end())
+                            {
+                                continue;
+                            }
+                            if (GEP->getNumOperands() != 2)
+                            {
+                                continue;
+                            }
+                            if (GEP->getOperand(1) != Cast)
+                            {
+                                continue;
+                            }
+                            for (User *Usr : GEP->users())
+                            {
+                                if (LoadInst *LI = dyn_cast<LoadInst>(Usr))
+                                {
+                                    return std::make_pair(Step, LI);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return {};
+    }
+
+    /// Decide if a loop is an array which inc/dec ptr.
+    /// R = phi(GEP(R, LoopIndvar))
+    /// load(R)/load(GEP2(R, 0, _))
+    /// where R is of ptr type
+    /// and phi, GEP, load, GEP2 are in loop
+    ///
+    /// Return: Option<(Step, ArrayIdx)>
+    /// 1. Step: LoopInvariant
+    /// 2. ArrayIdx: Load idx ptr to array
+    static std::experimental::optional<std::pair<Value *, LoadInst *>> isIncDecPtr(PHINode &Phi, const std::set<BasicBlock *> &LoopBBs, const Loop *L)
+    {
+        if (!Phi.getType()->isPointerTy())
+        {
+            return {};
+        }
+
+        Value *Step = nullptr;
+        for (auto &Incm : Phi.incoming_values())
+        {
+            if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(Incm))
+            {
+                if (LoopBBs.find(GEP->getParent()) == LoopBBs.end())
+                {
+                    continue;
+                }
+                if (GEP->getNumOperands() != 2)
+                {
+                    continue;
+                }
+                if (&Phi != GEP->getOperand(0))
+                {
+                    continue;
+                }
+                if (!L->isLoopInvariant(GEP->getOperand(1)))
+                {
+                    continue;
+                }
+                Step = GEP->getOperand(1);
+
+                std::vector<Instruction *> PhiOrGEPs;
+                PhiOrGEPs.push_back(&Phi);
+                for (auto *Usr : Phi.users())
+                {
+                    if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(Usr))
+                    {
+                        if (LoopBBs.find(GEP->getParent()) == LoopBBs.end())
+                        {
+                            continue;
+                        }
+                        if (GEP->getNumOperands() < 3)
+                        {
+                            continue;
+                        }
+                        if (ConstantInt *CI = dyn_cast<ConstantInt>(GEP->getOperand(1)))
+                        {
+                            if (!CI->isZero())
+                            {
+                                continue;
+                            }
+                            PhiOrGEPs.push_back(GEP);
+                        }
+                    }
+                }
+
+                for (Instruction *I : PhiOrGEPs)
+                {
+                    for (User *Usr : I->users())
+                    {
+                        if (LoadInst *LI = dyn_cast<LoadInst>(Usr))
+                        {
+                            return std::make_pair(Step, LI);
+                        }
+                    }
+                }
+            }
+        }
+        return {};
+    }
+
+    /// Decide if a loop is an array.
+    /// 1. inc/dec index
+    /// 2. inc/dec ptr
+    static std::experimental::optional<std::pair<Value *, LoadInst *>> isArray(Loop *L)
+    {
+        BasicBlock *Header = L->getHeader();
+        std::set<BasicBlock *> LoopBBs(L->getBlocks().begin(), L->getBlocks().end());
+        for (auto &Phi : Header->phis())
+        {
+            if (auto Res = isIncDecIndex(Phi, LoopBBs, L))
+            {
+                return Res;
+            }
+            else if (auto Res = isIncDecPtr(Phi, LoopBBs, L))
+            {
+                return Res;
+            }
+        }
+        return {};
+    }
+
+    LoopClassification::LoopClassification() : FunctionPass(ID), LPI(nullptr)
+    {
+        PassRegistry &Registry = *PassRegistry::getPassRegistry();
+        initializeLoopInfoWrapperPassPass(Registry);
+    }
+
+    void LoopClassification::getAnalysisUsage(AnalysisUsage &AU) const
+    {
+        AU.setPreservesAll();
+        AU.addRequired<LoopInfoWrapperPass>();
+    }
+
+    bool LoopClassification::runOnFunction(Function &F)
+    {
+        // Classes hold blocks and loads of the previous function, which cloning may have changed or freed
+        mapHeaderClass.clear();
+        LPI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+        return false;
+    }
+
+    void LoopClassification::releaseMemory()
+    {
+        mapHeaderClass.clear();
+        LPI = nullptr;
+    }
+
+    LoopClass LoopClassification::getLoopClass(Loop *L)
+    {
+        auto It = mapHeaderClass.find(L->getHeader());
+        if (It != mapHeaderClass.end())
+        {
+            return It->second;
+        }
+
+        LoopClass Class{LoopKind::Other, nullptr, 0, nullptr, nullptr};
+        if (auto ListData = isLinkedList(L))
+        {
+            Class.ListNext = *ListData;
+        }
+        // The array match wins, as it did for the readers of the LoopClassifier output
+        if (auto ArrData = isArray(L))
+        {
+            Class.Kind = LoopKind::Array;
+            Class.Indvar = ArrData->second;
+            Class.StepValue = ArrData->first;
+            if (ConstantInt *CI = dyn_cast<ConstantInt>(ArrData->first))
+            {
+                Class.Step = (int)CI->getSExtValue();
+            }
+        }
+        else if (Class.ListNext)
+        {
+            Class.Kind = LoopKind::LinkedList;
+            Class.Indvar = Class.ListNext;
+        }
+        return mapHeaderClass[L->getHeader()] = Class;
+    }
+
+    void LoopClassification::print(raw_ostream &OS, const Module *M) const
+    {
+        if (!LPI)
+        {
+            return;
+        }
+        for (Loop *L : LPI->getLoopsInPreorder())
+        {
+            auto It = mapHeaderClass.find(L->getHeader());
+            if (It == mapHeaderClass.end())
+            {
+                continue;
+            }
+            const LoopClass &Class = It->second;
+            OS << L->getHeader()->getName() << ": ";
+            switch (Class.Kind)
+            {
+                case LoopKind::Array:
+                    OS << "isArray, step ";
+                    if (isa<ConstantInt>(Class.StepValue))
+                    {
+                        OS << Class.Step;
+                    }
+                    else
+                    {
+                        OS << "?";
+                    }
+                    OS << ", indvar " << GetInstructionID(Class.Indvar) << "\n";
+                    break;
+                case LoopKind::LinkedList:
+                    OS << "isLinkedList, indvar " << GetInstructionID(Class.Indvar) << "\n";
+                    break;
+                default:
+                    OS << "other\n";
+                    break;
+            }
+        }
+    }
+} // namespace common
@@ -256,7 +256,7 @@ int mapFromOriginToCloned(ValueToValueMapTy &originClonedMapping, MonitoredRWIns
 unsigned MonitoredRWInsts::size()
 {
     return mapLoadID.size() + mapStoreID.size() + mapMemTransferID.size() + mapMemSetID.size() + mapFreadID.size() +
-           mapFgetcID.size() + mapOstreamID.size();
+           mapFgetcID.size() + mapOstreamID.size() + mapIOReadID.size();
 }
 
 bool MonitoredRWInsts::add(Instruction *pInst)
@@ -314,6 +314,12 @@ bool MonitoredRWInsts::add(Instruction *pInst)
                 mapOstreamID[pInst] = instID;
                 return true;
             }
+            else if (funcName == "read" || funcName == "recv" || funcName == "getline" || funcName == "fgets" ||
+                     funcName == "_ZNSi4readEPcl")
+            {
+                mapIOReadID[pInst] = instID;
+                return true;
+            }
         }
     }
     return false;
@@ -329,6 +335,7 @@ void MonitoredRWInsts::clear()
     mapFgetcID.clear();
     mapFreadID.clear();
     mapOstreamID.clear();
+    mapIOReadID.clear();
 }
 
 void MonitoredRWInsts::print(llvm::raw_ostream &os)
@@ -362,6 +369,10 @@ void MonitoredRWInsts::print(llvm::raw_ostream &os)
     {
         os << "Ostream," << kv.second << "\n";
     }
+    for (auto &kv : mapIOReadID)
+    {
+        os << "IORead," << kv.second << "\n";
+    }
 }
 
 void MonitoredRWInsts::dump()
@@ -401,10 +412,15 @@ void MonitoredRWInsts::diff(MonitoredRWInsts &rhs)
     {
         mapOstreamID.erase(kv.first);
     }
+    for (auto &kv : rhs.mapIOReadID)
+    {
+        mapIOReadID.erase(kv.first);
+    }
 }
 
 bool MonitoredRWInsts::empty()
 {
     return mapLoadID.empty() && mapStoreID.empty() && mapMemSetID.empty() && mapMemTransferID.empty() &&
-           mapFgetcID.empty() && mapFreadID.empty() && mapOstreamID.empty();
+           mapFgetcID.empty() && mapFreadID.empty() && mapOstreamID.empty() &&
+           mapIOReadID.empty();
 }
@@ -13,7 +13,7 @@ namespace common
     unsigned long MonitoredRWInsts::size()
     {
         return mapLoadID.size() + mapStoreID.size() + mapMemTransferID.size() + mapMemSetID.size() + mapFreadID.size() +
-               mapFgetcID.size() + mapOstreamID.size();
+               mapFgetcID.size() + mapOstreamID.size() + mapIOReadID.size();
     }
 
     bool MonitoredRWInsts::add(Instruction *pInst)
@@ -70,6 +70,12 @@ namespace common
                     mapOstreamID[pInst] = instID;
                     return true;
                 }
+                else if (funcName == "read" || funcName == "recv" || funcName == "getline" || funcName == "fgets" ||
+                         funcName == "_ZNSi4readEPcl")
+                {
+                    mapIOReadID[pInst] = instID;
+                    return true;
+                }
             }
         }
         return false;
@@ -84,6 +90,7 @@ namespace common
         mapFgetcID.clear();
         mapFreadID.clear();
         mapOstreamID.clear();
+        mapIOReadID.clear();
     }
 
     void MonitoredRWInsts::print(llvm::raw_ostream &os)
@@ -116,6 +123,10 @@ namespace common
         {
             os << "Ostream," << kv.second << "\n";
         }
+        for (auto &kv : mapIOReadID)
+        {
+            os << "IORead," << kv.second << "\n";
+        }
     }
 
     void MonitoredRWInsts::dump()
@@ -153,12 +164,17 @@ namespace common
         {
             mapOstreamID.erase(kv.first);
         }
+        for (auto &kv : rhs.mapIOReadID)
+        {
+            mapIOReadID.erase(kv.first);
+        }
     }
 
     bool MonitoredRWInsts::empty()
     {
         return mapLoadID.empty() && mapStoreID.empty() && mapMemSetID.empty() && mapMemTransferID.empty() &&
-               mapFgetcID.empty() && mapFreadID.empty() && mapOstreamID.empty();
+               mapFgetcID.empty() && mapFreadID.empty() && mapOstreamID.empty() &&
+               mapIOReadID.empty();
     }
 
     bool isMonitoredLoad(LoadInst *pLoad)
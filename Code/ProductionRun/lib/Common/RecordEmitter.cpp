@@ -0,0 +1,932 @@
+#include "Common/RecordEmitter.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "Common/Constants.h"
+#include "Common/MonitoredInsts.h"
+#include <algorithm>
+
+using namespace llvm;
+
+namespace common
+{
+    static cl::opt<RecordFormat> recordFormat("record-format",
+                                              cl::desc("Layout of the trace records"),
+                                              cl::values(clEnumValN(FixedRecord, "fixed", "16-byte records"),
+                                                         clEnumValN(CompactRecord, "compact", "12-byte records")),
+                                              cl::init(FixedRecord));
+
+    static cl::opt<RecordSink> recordSink("record-sink",
+                                          cl::desc("Where the trace records are written"),
+                                          cl::values(clEnumValN(SharedMemorySink, "shm", "one shared memory buffer"),
+                                                     clEnumValN(FileSink, "file", "one mmap-ed file"),
+                                                     clEnumValN(PerThreadSink, "thread", "one shared memory buffer per thread")),
+                                          cl::init(SharedMemorySink));
+
+    static cl::opt<bool> sampleControl("sample-control",
+                                       cl::desc("Switch sampling on/off and change SAMPLE_RATE by signals at runtime"),
+                                       cl::init(false));
+
+    void RecordEmitter::SetupInit(Module &M)
+    {
+        this->pModule = &M;
+        this->Format = recordFormat;
+        this->Sink = recordSink;
+        this->bSampleControl = sampleControl;
+        SetupTypes();
+        SetupStructs();
+        SetupConstants();
+        SetupGlobals();
+        SetupFunctions();
+    }
+
+    void RecordEmitter::SetupTypes()
+    {
+        this->VoidType = Type::getVoidTy(pModule->getContext());
+        this->LongType = IntegerType::get(pModule->getContext(), 64);
+        this->IntType = IntegerType::get(pModule->getContext(), 32);
+        this->CharType = IntegerType::get(pModule->getContext(), 8);
+        this->CharStarType = PointerType::get(this->CharType, 0);
+    }
+
+    void RecordEmitter::SetupStructs()
+    {
+        std::vector<Type *> struct_fields;
+
+        assert(pModule->getTypeByName("struct.stMemRecord") == nullptr);
+        this->struct_stMemRecord = StructType::create(pModule->getContext(), "struct.stMemRecord");
+        struct_fields.clear();
+        struct_fields.push_back(this->LongType); // address
+        struct_fields.push_back(this->IntType);  // length
+        struct_fields.push_back(this->IntType);  // id (+: Read, -: Write, Special:DELIMIT, LOOP_BEGIN, LOOP_END)
+        if (this->struct_stMemRecord->isOpaque())
+        {
+            this->struct_stMemRecord->setBody(struct_fields, false);
+        }
+
+        // packed <{address | length << 48, id}>
+        this->struct_stCompactRecord = StructType::create(pModule->getContext(), "struct.stCompactRecord");
+        struct_fields.clear();
+        struct_fields.push_back(this->LongType); // address | length << 48
+        struct_fields.push_back(this->IntType);  // id
+        this->struct_stCompactRecord->setBody(struct_fields, true);
+
+        // packed <{address | 0xFFFF << 48, id, length}>
+        this->struct_stCompactExtRecord = StructType::create(pModule->getContext(), "struct.stCompactExtRecord");
+        struct_fields.push_back(this->IntType); // length
+        this->struct_stCompactExtRecord->setBody(struct_fields, true);
+    }
+
+    void RecordEmitter::SetupConstants()
+    {
+        // long: 0, 1, 12, 16
+        this->ConstantLong0 = ConstantInt::get(pModule->getContext(), APInt(64, StringRef("0"), 10));
+        this->ConstantLong1 = ConstantInt::get(pModule->getContext(), APInt(64, StringRef("1"), 10));
+        this->ConstantLong12 = ConstantInt::get(pModule->getContext(), APInt(64, StringRef("12"), 10));
+        this->ConstantLong16 = ConstantInt::get(pModule->getContext(), APInt(64, StringRef("16"), 10));
+
+        // int: -1, 0, 1, 2, 3, 4, 5, 6
+        this->ConstantIntN1 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("-1"), 10));
+        this->ConstantInt0 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("0"), 10));
+        this->ConstantInt1 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("1"), 10));
+        this->ConstantInt2 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("2"), 10));
+        this->ConstantInt3 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("3"), 10));
+        this->ConstantInt4 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("4"), 10));
+        this->ConstantInt5 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("5"), 10));
+        // int: delimit, loop_begin, loop_end, stride, negative_stride, affine, sample_weight
+        this->ConstantDelimit = ConstantInt::get(pModule->getContext(), APInt(32, StringRef(std::to_string(DELIMIT)), 10));
+        this->ConstantLoopBegin = ConstantInt::get(pModule->getContext(), APInt(32, StringRef(std::to_string(LOOP_BEGIN)), 10));
+        this->ConstantLoopEnd = ConstantInt::get(pModule->getContext(), APInt(32, StringRef(std::to_string(LOOP_END)), 10));
+        this->ConstantLoopStride = ConstantInt::get(pModule->getContext(), APInt(32, StringRef(std::to_string(LOOP_STRIDE)), 10));
+        this->ConstantLoopNegativeStride = ConstantInt::get(pModule->getContext(), APInt(32, StringRef(std::to_string(LOOP_NEGATIVE_STRIDE)), 10));
+        this->ConstantLoopAffine = ConstantInt::get(pModule->getContext(), APInt(32, StringRef(std::to_string(LOOP_AFFINE)), 10));
+        this->ConstantSampleWeight = ConstantInt::get(pModule->getContext(), APInt(32, StringRef(std::to_string(SAMPLE_WEIGHT)), 10));
+        this->ConstantLoopLinkedList = ConstantInt::get(pModule->getContext(), APInt(32, StringRef(std::to_string(LOOP_LINKED_LIST)), 10));
+        this->ConstantIOSummary = ConstantInt::get(pModule->getContext(), APInt(32, StringRef(std::to_string(IO_SUMMARY)), 10));
+
+        // char*: NULL
+        this->ConstantNULL = ConstantPointerNull::get(this->CharStarType);
+    }
+
+    void RecordEmitter::SetupGlobals()
+    {
+        // The globals below are only used by the instrumented code of this (whole-program) module: the runtime gets
+        // them as arguments (FinalizeMemHooks, InitSampleControl, SampleBegin) and never by name. Private linkage
+        // keeps them from clashing with program symbols or with another instrumented module, as LoopBase and
+        // LoopLLSample did. Only the per-thread buffer and cost are external, they are defined in the runtime.
+
+        // int numGlobalCounter = 1; (__thread with the per-thread sink, each thread starts its own countdown)
+        assert(pModule->getGlobalVariable("numGlobalCounter") == nullptr);
+        this->numGlobalCounter = new GlobalVariable(*pModule, this->IntType, false, GlobalValue::PrivateLinkage, nullptr,
+                                                    "numGlobalCounter", nullptr, GetCounterTLSMode());
+        this->numGlobalCounter->setAlignment(4);
+        this->numGlobalCounter->setInitializer(this->ConstantInt1);
+
+        // int SAMPLE_RATE = 0;
+        assert(pModule->getGlobalVariable("SAMPLE_RATE") == nullptr);
+        this->SAMPLE_RATE = new GlobalVariable(*pModule, this->IntType, false, GlobalValue::PrivateLinkage, nullptr,
+                                               "SAMPLE_RATE");
+        this->SAMPLE_RATE->setAlignment(4);
+        this->SAMPLE_RATE->setInitializer(this->ConstantInt0);
+
+        // int SAMPLE_ENABLED = 1;
+        this->SAMPLE_ENABLED = nullptr;
+        if (this->bSampleControl)
+        {
+            assert(pModule->getGlobalVariable("SAMPLE_ENABLED") == nullptr);
+            this->SAMPLE_ENABLED = new GlobalVariable(*pModule, this->IntType, false, GlobalValue::PrivateLinkage,
+                                                      nullptr, "SAMPLE_ENABLED");
+            this->SAMPLE_ENABLED->setAlignment(4);
+            this->SAMPLE_ENABLED->setInitializer(this->ConstantInt1);
+        }
+
+        if (this->Sink == PerThreadSink)
+        {
+            // extern __thread char *pcBuffer_CPI; extern __thread long iBufferIndex_CPI; (defined in the runtime)
+            assert(pModule->getGlobalVariable("pcBuffer_CPI") == nullptr);
+            this->pcBuffer_CPI = new GlobalVariable(*pModule, this->CharStarType, false, GlobalValue::ExternalLinkage, nullptr,
+                                                    "pcBuffer_CPI", nullptr, GlobalValue::InitialExecTLSModel);
+            this->pcBuffer_CPI->setAlignment(8);
+
+            assert(pModule->getGlobalVariable("iBufferIndex_CPI") == nullptr);
+            this->iBufferIndex_CPI = new GlobalVariable(*pModule, this->LongType, false, GlobalValue::ExternalLinkage, nullptr,
+                                                        "iBufferIndex_CPI", nullptr, GlobalValue::InitialExecTLSModel);
+            this->iBufferIndex_CPI->setAlignment(8);
+        }
+        else
+        {
+            // char *pcBuffer_CPI = nullptr;
+            assert(pModule->getGlobalVariable("pcBuffer_CPI") == nullptr);
+            this->pcBuffer_CPI = new GlobalVariable(*pModule, this->CharStarType, false, GlobalValue::PrivateLinkage, nullptr,
+                                                    "pcBuffer_CPI");
+            this->pcBuffer_CPI->setAlignment(8);
+            this->pcBuffer_CPI->setInitializer(this->ConstantNULL);
+
+            // long iBufferIndex_CPI = 0;
+            assert(pModule->getGlobalVariable("iBufferIndex_CPI") == nullptr);
+            this->iBufferIndex_CPI = new GlobalVariable(*pModule, this->LongType, false, GlobalValue::PrivateLinkage, nullptr,
+                                                        "iBufferIndex_CPI");
+            this->iBufferIndex_CPI->setAlignment(8);
+            this->iBufferIndex_CPI->setInitializer(this->ConstantLong0);
+        }
+
+        // struct_stLogRecord Record_CPI
+        assert(pModule->getGlobalVariable("Record_CPI") == nullptr);
+        this->Record_CPI = new GlobalVariable(*pModule, this->struct_stMemRecord, false, GlobalValue::PrivateLinkage,
+                                              nullptr,
+                                              "Record_CPI");
+        this->Record_CPI->setAlignment(16);
+        ConstantAggregateZero *const_struct = ConstantAggregateZero::get(this->struct_stMemRecord);
+        this->Record_CPI->setInitializer(const_struct);
+
+        // const char *SAMPLE_RATE_ptr = "SAMPLE_RATE";
+        ArrayType *ArrayTy12 = ArrayType::get(this->CharType, 12);
+        GlobalVariable *pArrayStr = new GlobalVariable(*pModule, ArrayTy12, true, GlobalValue::PrivateLinkage, nullptr, "");
+        pArrayStr->setAlignment(1);
+        Constant *ConstArray = ConstantDataArray::getString(pModule->getContext(), "SAMPLE_RATE", true);
+        std::vector<Constant *> vecIndex;
+        vecIndex.push_back(this->ConstantInt0);
+        vecIndex.push_back(this->ConstantInt0);
+        this->SAMPLE_RATE_ptr = ConstantExpr::getGetElementPtr(ArrayTy12, pArrayStr, vecIndex);
+        pArrayStr->setInitializer(ConstArray);
+
+        // const char *EmptyStr_ptr = "";
+        Constant *ConstEmpty = ConstantDataArray::getString(pModule->getContext(), "", true);
+        GlobalVariable *pEmptyStr = new GlobalVariable(*pModule, ConstEmpty->getType(), true,
+                                                       GlobalValue::PrivateLinkage, ConstEmpty, "");
+        pEmptyStr->setAlignment(1);
+        this->EmptyStr_ptr = ConstantExpr::getBitCast(pEmptyStr, this->CharStarType);
+
+        if (this->Sink == PerThreadSink)
+        {
+            // extern __thread long numGlobalCost_CPI; (defined in the runtime, which ends the buffer of a created
+            // thread with it)
+            assert(pModule->getGlobalVariable("numGlobalCost_CPI") == nullptr);
+            this->numGlobalCost = new GlobalVariable(*pModule, this->LongType, false, GlobalValue::ExternalLinkage,
+                                                     nullptr, "numGlobalCost_CPI", nullptr,
+                                                     GlobalValue::InitialExecTLSModel);
+            this->numGlobalCost->setAlignment(8);
+        }
+        else
+        {
+            // long numGlobalCost = 0;
+            assert(pModule->getGlobalVariable("numGlobalCost") == nullptr);
+            this->numGlobalCost = new GlobalVariable(*pModule, this->LongType, false, GlobalValue::PrivateLinkage,
+                                                     nullptr, "numGlobalCost");
+            this->numGlobalCost->setAlignment(8);
+            this->numGlobalCost->setInitializer(this->ConstantLong0);
+        }
+
+        // __thread long IO_BYTES = 0;
+        assert(pModule->getGlobalVariable("IO_BYTES") == nullptr);
+        this->IO_BYTES = new GlobalVariable(*pModule, this->LongType, false, GlobalValue::PrivateLinkage, nullptr,
+                                            "IO_BYTES", nullptr, GlobalValue::InitialExecTLSModel);
+        this->IO_BYTES->setAlignment(8);
+        this->IO_BYTES->setInitializer(this->ConstantLong0);
+    }
+
+    GlobalValue::ThreadLocalMode RecordEmitter::GetCounterTLSMode() const
+    {
+        return this->Sink == PerThreadSink ? GlobalValue::InitialExecTLSModel : GlobalValue::NotThreadLocal;
+    }
+
+    void RecordEmitter::SetupFunctions()
+    {
+        std::vector<Type *> ArgTypes;
+
+        // getenv
+        this->getenv = pModule->getFunction("getenv");
+        if (!this->getenv)
+        {
+            ArgTypes.push_back(this->CharStarType);
+            FunctionType *getenv_FuncTy = FunctionType::get(this->CharStarType, ArgTypes, false);
+            this->getenv = Function::Create(getenv_FuncTy, GlobalValue::ExternalLinkage, "getenv", pModule);
+            this->getenv->setCallingConv(CallingConv::C);
+            ArgTypes.clear();
+        }
+
+        // atoi
+        this->function_atoi = pModule->getFunction("atoi");
+        if (!this->function_atoi)
+        {
+            ArgTypes.push_back(this->CharStarType);
+            FunctionType *atoi_FuncTy = FunctionType::get(this->IntType, ArgTypes, false);
+            this->function_atoi = Function::Create(atoi_FuncTy, GlobalValue::ExternalLinkage, "atoi", pModule);
+            this->function_atoi->setCallingConv(CallingConv::C);
+            ArgTypes.clear();
+        }
+
+        // geo
+        this->geo = this->pModule->getFunction("geo");
+        if (!this->geo)
+        {
+            ArgTypes.push_back(this->IntType);
+            FunctionType *Geo_FuncTy = FunctionType::get(this->IntType, ArgTypes, false);
+            this->geo = Function::Create(Geo_FuncTy, GlobalValue::ExternalLinkage, "geo", this->pModule);
+            this->geo->setCallingConv(CallingConv::C);
+            ArgTypes.clear();
+        }
+
+        // SampleBegin
+        this->SampleBegin = this->pModule->getFunction("SampleBegin");
+        if (!this->SampleBegin)
+        {
+            ArgTypes.push_back(this->IntType);
+            FunctionType *SampleBegin_FuncTy = FunctionType::get(this->IntType, ArgTypes, false);
+            this->SampleBegin = Function::Create(SampleBegin_FuncTy, GlobalValue::ExternalLinkage, "SampleBegin",
+                                                 this->pModule);
+            this->SampleBegin->setCallingConv(CallingConv::C);
+            ArgTypes.clear();
+        }
+
+        // SampleEnd
+        this->SampleEnd = this->pModule->getFunction("SampleEnd");
+        if (!this->SampleEnd)
+        {
+            FunctionType *SampleEnd_FuncTy = FunctionType::get(this->VoidType, ArgTypes, false);
+            this->SampleEnd = Function::Create(SampleEnd_FuncTy, GlobalValue::ExternalLinkage, "SampleEnd",
+                                               this->pModule);
+            this->SampleEnd->setCallingConv(CallingConv::C);
+        }
+
+        // InitSampleControl
+        this->InitSampleControl = this->pModule->getFunction("InitSampleControl");
+        if (!this->InitSampleControl)
+        {
+            ArgTypes.push_back(PointerType::get(this->IntType, 0));
+            ArgTypes.push_back(PointerType::get(this->IntType, 0));
+            FunctionType *InitSampleControl_FuncTy = FunctionType::get(this->VoidType, ArgTypes, false);
+            this->InitSampleControl = Function::Create(InitSampleControl_FuncTy, GlobalValue::ExternalLinkage,
+                                                       "InitSampleControl", this->pModule);
+            this->InitSampleControl->setCallingConv(CallingConv::C);
+            ArgTypes.clear();
+        }
+
+        // InitMemHooks / InitFileMemHooks / InitThreadMemHooks
+        const char *InitName = "InitMemHooks";
+        const char *FinalizeName = "FinalizeMemHooks";
+        if (this->Sink == FileSink)
+        {
+            InitName = "InitFileMemHooks";
+            FinalizeName = "FinalizeFileMemHooks";
+        }
+        else if (this->Sink == PerThreadSink)
+        {
+            InitName = "InitThreadMemHooks";
+            FinalizeName = "FinalizeThreadMemHooks";
+        }
+
+        this->InitMemHooks = this->pModule->getFunction(InitName);
+        if (!this->InitMemHooks)
+        {
+            FunctionType *InitHooks_FuncTy = FunctionType::get(this->CharStarType, ArgTypes, false);
+            this->InitMemHooks = Function::Create(InitHooks_FuncTy, GlobalValue::ExternalLinkage, InitName,
+                                                  this->pModule);
+            this->InitMemHooks->setCallingConv(CallingConv::C);
+            ArgTypes.clear();
+        }
+
+        if (this->Sink == PerThreadSink)
+        {
+            // char *InitForeignThreadMemHooks()
+            this->InitForeignThreadMemHooks = this->pModule->getFunction("InitForeignThreadMemHooks");
+            if (!this->InitForeignThreadMemHooks)
+            {
+                FunctionType *InitForeign_FuncTy = FunctionType::get(this->CharStarType, ArgTypes, false);
+                this->InitForeignThreadMemHooks = Function::Create(InitForeign_FuncTy, GlobalValue::ExternalLinkage,
+                                                                   "InitForeignThreadMemHooks", this->pModule);
+                this->InitForeignThreadMemHooks->setCallingConv(CallingConv::C);
+            }
+        }
+
+        // FinalizeMemHooks / FinalizeFileMemHooks / FinalizeThreadMemHooks
+        this->FinalizeMemHooks = this->pModule->getFunction(FinalizeName);
+        if (!this->FinalizeMemHooks)
+        {
+            ArgTypes.push_back(this->LongType);
+            FunctionType *FinalizeMemHooks_FuncTy = FunctionType::get(this->VoidType, ArgTypes, false);
+            this->FinalizeMemHooks = Function::Create(FinalizeMemHooks_FuncTy, GlobalValue::ExternalLinkage,
+                                                      FinalizeName, this->pModule);
+            this->FinalizeMemHooks->setCallingConv(CallingConv::C);
+            ArgTypes.clear();
+        }
+    }
+
+    void RecordEmitter::InlineSetRecord(Value *address, Value *length, Value *id, Instruction *InsertBefore, Value *keep)
+    {
+        this->setRecordFuncs.insert(InsertBefore->getFunction());
+        if (this->Format == CompactRecord)
+        {
+            InlineSetCompactRecord(address, length, id, InsertBefore, keep);
+            return;
+        }
+
+        LoadInst *pLoadPointer;
+        LoadInst *pLoadIndex;
+        BinaryOperator *pBinary;
+        CastInst *pCastInst;
+        PointerType *pPointerType;
+
+        // char *pc = (char *)pcBuffer_CPI[iBufferIndex_CPI];
+        pLoadPointer = new LoadInst(this->pcBuffer_CPI, "", false, InsertBefore);
+        pLoadPointer->setAlignment(8);
+        pLoadIndex = new LoadInst(this->iBufferIndex_CPI, "", false, InsertBefore);
+        pLoadIndex->setAlignment(8);
+        GetElementPtrInst *getElementPtr = GetElementPtrInst::Create(this->CharType, pLoadPointer, pLoadIndex, "",
+                                                                     InsertBefore);
+        // struct_stMemRecord *ps = (struct_stMemRecord *)pc;
+        pPointerType = PointerType::get(this->struct_stMemRecord, 0);
+        pCastInst = new BitCastInst(getElementPtr, pPointerType, "", InsertBefore);
+
+        // ps->address = address;
+        std::vector<Value *> ptr_address_indices;
+        ptr_address_indices.push_back(this->ConstantInt0);
+        ptr_address_indices.push_back(this->ConstantInt0);
+        GetElementPtrInst *pAddress = GetElementPtrInst::Create(this->struct_stMemRecord, pCastInst,
+                                                                ptr_address_indices, "", InsertBefore);
+        auto pStoreAddress = new StoreInst(address, pAddress, false, InsertBefore);
+        pStoreAddress->setAlignment(8);
+
+        // ps->length = length;
+        std::vector<Value *> ptr_length_indices;
+        ptr_length_indices.push_back(this->ConstantInt0);
+        ptr_length_indices.push_back(this->ConstantInt1);
+        GetElementPtrInst *pLength = GetElementPtrInst::Create(this->struct_stMemRecord, pCastInst,
+                                                               ptr_length_indices, "", InsertBefore);
+        auto pStoreLength = new StoreInst(length, pLength, false, InsertBefore);
+        pStoreLength->setAlignment(8);
+
+        // ps->id = id;
+        std::vector<Value *> ptr_id_indices;
+        ptr_id_indices.push_back(this->ConstantInt0);
+        ptr_id_indices.push_back(this->ConstantInt2);
+        GetElementPtrInst *pFlag = GetElementPtrInst::Create(this->struct_stMemRecord, pCastInst, ptr_id_indices,
+                                                             "", InsertBefore);
+        auto pStoreFlag = new StoreInst(id, pFlag, false, InsertBefore);
+        pStoreFlag->setAlignment(4);
+
+        // iBufferIndex_CPI += keep ? 16 : 0
+        Value *pSize = this->ConstantLong16;
+        if (keep)
+        {
+            pSize = SelectInst::Create(keep, this->ConstantLong16, this->ConstantLong0, "", InsertBefore);
+        }
+        pBinary = BinaryOperator::Create(Instruction::Add, pLoadIndex, pSize, "iBufferIndex+=16:", InsertBefore);
+        auto pStoreIndex = new StoreInst(pBinary, this->iBufferIndex_CPI, false, InsertBefore);
+        pStoreIndex->setAlignment(8);
+    }
+
+    void RecordEmitter::InlineSetCompactRecord(Value *address, Value *length, Value *id, Instruction *InsertBefore,
+                                               Value *keep)
+    {
+        // Only a constant length below 0xFFFF fits into the high bits of a user space address (see CompactRecord).
+        // The final cost record {numGlobalCost, 0, 0} keeps the cost in the low 48 bits.
+        ConstantInt *pConstLength = dyn_cast<ConstantInt>(length);
+        bool bExtended = !pConstLength || pConstLength->getZExtValue() >= COMPACT_LENGTH_EXTENDED;
+        uint64_t uHighBits = (bExtended ? COMPACT_LENGTH_EXTENDED : pConstLength->getZExtValue()) << COMPACT_LENGTH_SHIFT;
+        StructType *pRecordType = bExtended ? this->struct_stCompactExtRecord : this->struct_stCompactRecord;
+
+        // char *pc = (char *)pcBuffer_CPI[iBufferIndex_CPI];
+        LoadInst *pLoadPointer = new LoadInst(this->pcBuffer_CPI, "", false, InsertBefore);
+        pLoadPointer->setAlignment(8);
+        LoadInst *pLoadIndex = new LoadInst(this->iBufferIndex_CPI, "", false, InsertBefore);
+        pLoadIndex->setAlignment(8);
+        GetElementPtrInst *getElementPtr = GetElementPtrInst::Create(this->CharType, pLoadPointer, pLoadIndex, "",
+                                                                     InsertBefore);
+        CastInst *pCastInst = new BitCastInst(getElementPtr, PointerType::get(pRecordType, 0), "", InsertBefore);
+
+        // ps->address = address | length << 48;
+        Value *pPacked = address;
+        if (uHighBits != 0)
+        {
+            pPacked = BinaryOperator::Create(Instruction::Or, address, ConstantInt::get(this->LongType, uHighBits),
+                                             "compact_address", InsertBefore);
+        }
+        std::vector<Value *> ptr_indices;
+        ptr_indices.push_back(this->ConstantInt0);
+        ptr_indices.push_back(this->ConstantInt0);
+        GetElementPtrInst *pAddress = GetElementPtrInst::Create(pRecordType, pCastInst, ptr_indices, "", InsertBefore);
+        auto pStoreAddress = new StoreInst(pPacked, pAddress, false, InsertBefore);
+        pStoreAddress->setAlignment(4);
+
+        // ps->id = id;
+        ptr_indices[1] = this->ConstantInt1;
+        GetElementPtrInst *pFlag = GetElementPtrInst::Create(pRecordType, pCastInst, ptr_indices, "", InsertBefore);
+        auto pStoreFlag = new StoreInst(id, pFlag, false, InsertBefore);
+        pStoreFlag->setAlignment(4);
+
+        // ps->length = length;
+        if (bExtended)
+        {
+            ptr_indices[1] = this->ConstantInt2;
+            GetElementPtrInst *pLength = GetElementPtrInst::Create(pRecordType, pCastInst, ptr_indices, "", InsertBefore);
+            auto pStoreLength = new StoreInst(length, pLength, false, InsertBefore);
+            pStoreLength->setAlignment(4);
+        }
+
+        // iBufferIndex_CPI += keep ? 12 or 16 : 0
+        Value *pSize = bExtended ? this->ConstantLong16 : this->ConstantLong12;
+        if (keep)
+        {
+            pSize = SelectInst::Create(keep, pSize, this->ConstantLong0, "", InsertBefore);
+        }
+        BinaryOperator *pBinary = BinaryOperator::Create(Instruction::Add, pLoadIndex, pSize, "iBufferIndex+=sizeof:",
+                                                         InsertBefore);
+        auto pStoreIndex = new StoreInst(pBinary, this->iBufferIndex_CPI, false, InsertBefore);
+        pStoreIndex->setAlignment(8);
+    }
+
+    void RecordEmitter::InlineHookDelimit(Instruction *InsertBefore)
+    {
+        InlineFlushIO(InsertBefore);
+        InlineSetRecord(this->ConstantLong0, this->ConstantInt0, this->ConstantDelimit, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookLoopDelimit(unsigned loopID, Instruction *InsertBefore)
+    {
+        assert(loopID != 0 && InsertBefore);
+        InlineFlushIO(InsertBefore);
+        LoadInst *pLoad = new LoadInst(this->numGlobalCost, "", false, InsertBefore);
+        ConstantInt *const_loop = ConstantInt::get(this->IntType, loopID);
+        InlineSetRecord(pLoad, const_loop, this->ConstantDelimit, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookLoad(LoadInst *pLoad, unsigned uID, Instruction *InsertBefore)
+    {
+        assert(pLoad && InsertBefore);
+        assert(uID != INVALID_ID && MIN_ID <= uID && uID <= MAX_ID);
+        int ID = uID;
+
+        const DataLayout &DL = this->pModule->getDataLayout();
+
+        Value *addr = pLoad->getPointerOperand();
+        assert(addr);
+        Type *type = pLoad->getType();
+        assert(type);
+
+        ConstantInt *const_length = ConstantInt::get(this->IntType, DL.getTypeAllocSize(type));
+        CastInst *int64_address = new PtrToIntInst(addr, this->LongType, "", InsertBefore);
+        ConstantInt *const_id = ConstantInt::get(this->IntType, ID, true);
+        InlineSetRecord(int64_address, const_length, const_id, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookStore(StoreInst *pStore, unsigned uID, Instruction *InsertBefore)
+    {
+        assert(pStore && InsertBefore);
+        assert(uID != INVALID_ID && MIN_ID <= uID && uID <= MAX_ID);
+        // Write: Negative ID
+        int ID = -uID;
+
+        const DataLayout &DL = this->pModule->getDataLayout();
+
+        Value *addr = pStore->getPointerOperand();
+        assert(addr);
+        Type *type = pStore->getValueOperand()->getType();
+        assert(type);
+
+        ConstantInt *const_length = ConstantInt::get(this->IntType, DL.getTypeAllocSize(type));
+        CastInst *int64_address = new PtrToIntInst(addr, this->LongType, "", InsertBefore);
+        ConstantInt *const_id = ConstantInt::get(this->IntType, ID, true);
+        InlineSetRecord(int64_address, const_length, const_id, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookMemSet(MemSetInst *pMemSet, unsigned uID, Instruction *InsertBefore)
+    {
+        assert(pMemSet && InsertBefore);
+        assert(uID != INVALID_ID && MIN_ID <= uID && uID <= MAX_ID);
+        // Write: Negative ID
+        int ID = -uID;
+
+        Value *dest = pMemSet->getDest();
+        assert(dest);
+        Value *len = pMemSet->getLength();
+        assert(len);
+        CastInst *int64_address = new PtrToIntInst(dest, this->LongType, "", InsertBefore);
+        CastInst *int32_len = new TruncInst(len, this->IntType, "memset_len_conv", InsertBefore);
+        ConstantInt *const_id = ConstantInt::get(this->IntType, ID, true);
+        InlineSetRecord(int64_address, int32_len, const_id, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookMemTransfer(MemTransferInst *pMemTransfer, unsigned uID, Instruction *InsertBefore)
+    {
+        assert(pMemTransfer && InsertBefore);
+        assert(uID != INVALID_ID && MIN_ID <= uID && uID <= MAX_ID);
+        // Read Src: positive ID
+        int srcID = uID;
+        // Write Dest: Negative ID
+        int dstID = -uID;
+
+        Value *src = pMemTransfer->getSource();
+        assert(src);
+        Value *dest = pMemTransfer->getDest();
+        assert(dest);
+        Value *len = pMemTransfer->getLength();
+        assert(len);
+        CastInst *src_int64_address = new PtrToIntInst(src, this->LongType, "", InsertBefore);
+        CastInst *dest_int64_address = new PtrToIntInst(dest, this->LongType, "", InsertBefore);
+        CastInst *int32_len = new TruncInst(len, this->IntType, "memtransfer_len_conv", InsertBefore);
+        ConstantInt *const_src_id = ConstantInt::get(this->IntType, srcID, true);
+        ConstantInt *const_dst_id = ConstantInt::get(this->IntType, dstID, true);
+        InlineSetRecord(src_int64_address, int32_len, const_src_id, InsertBefore);
+        InlineSetRecord(dest_int64_address, int32_len, const_dst_id, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookFgetc(Instruction *pCall, unsigned uID, Instruction *InsertBefore)
+    {
+        assert(pCall && InsertBefore);
+        assert(uID != INVALID_ID && MIN_ID <= uID && uID <= MAX_ID);
+
+        InlineAddIOBytes(this->ConstantLong1, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookFread(Instruction *pCall, unsigned uID, Instruction *InsertBefore)
+    {
+        assert(pCall && InsertBefore);
+        assert(uID != INVALID_ID && MIN_ID <= uID && uID <= MAX_ID);
+
+        CastInst *length = CastInst::CreateIntegerCast(pCall, this->LongType, false, "fread_len_conv", InsertBefore);
+        InlineAddIOBytes(length, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookIORead(Instruction *pCall, unsigned uID, Instruction *InsertBefore)
+    {
+        assert(pCall && InsertBefore);
+        assert(uID != INVALID_ID && MIN_ID <= uID && uID <= MAX_ID);
+
+        Function *pCallee = getCalleeFunc(pCall);
+        assert(pCallee);
+        StringRef funcName = pCallee->getName();
+        CallSite cs(pCall);
+
+        Value *pBytes;
+        if (funcName == "fgets")
+        {
+            // strlen(ret ? ret : ""), ret is NULL at EOF
+            ICmpInst *pIsNull = new ICmpInst(InsertBefore, ICmpInst::ICMP_EQ, pCall,
+                                             ConstantPointerNull::get(cast<PointerType>(pCall->getType())));
+            CastInst *pLine = new BitCastInst(pCall, this->CharStarType, "", InsertBefore);
+            SelectInst *pStr = SelectInst::Create(pIsNull, this->EmptyStr_ptr, pLine, "", InsertBefore);
+            Function *pStrlen = pModule->getFunction("strlen");
+            if (!pStrlen)
+            {
+                FunctionType *Strlen_FuncTy = FunctionType::get(this->LongType, {this->CharStarType}, false);
+                pStrlen = Function::Create(Strlen_FuncTy, GlobalValue::ExternalLinkage, "strlen", pModule);
+            }
+            pBytes = CallInst::Create(pStrlen, {pStr}, "fgets_len", InsertBefore);
+        }
+        else if (funcName == "_ZNSi4readEPcl")
+        {
+            // is.gcount(), std::istream::read returns is
+            Value *pStream = cs.getArgument(0);
+            Function *pGcount = pModule->getFunction("_ZNKSi6gcountEv");
+            if (!pGcount)
+            {
+                FunctionType *Gcount_FuncTy = FunctionType::get(this->LongType, {pStream->getType()}, false);
+                pGcount = Function::Create(Gcount_FuncTy, GlobalValue::ExternalLinkage, "_ZNKSi6gcountEv", pModule);
+            }
+            pBytes = CallInst::Create(pGcount, {pStream}, "istream_read_len", InsertBefore);
+        }
+        else
+        {
+            // read, recv, getline: ssize_t, -1 at EOF or on error
+            CastInst *pRet = CastInst::CreateIntegerCast(pCall, this->LongType, true, "", InsertBefore);
+            ICmpInst *pPositive = new ICmpInst(InsertBefore, ICmpInst::ICMP_SGT, pRet, this->ConstantLong0);
+            pBytes = SelectInst::Create(pPositive, pRet, this->ConstantLong0, "io_read_len", InsertBefore);
+        }
+        InlineAddIOBytes(pBytes, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookOstream(Instruction *pCall, unsigned uID, Instruction *InsertBefore)
+    {
+        assert(pCall && InsertBefore);
+        assert(uID != INVALID_ID && MIN_ID <= uID && uID <= MAX_ID);
+        int ID = uID;
+
+        const DataLayout &DL = this->pModule->getDataLayout();
+
+        CallSite cs(pCall);
+        Value *pSecondArg = cs.getArgument(1);
+        assert(pSecondArg);
+
+        Type *type = pSecondArg->getType();
+        assert(type);
+        Type *type1 = type->getContainedType(0);
+        assert(type1);
+
+        ConstantInt *const_length = ConstantInt::get(this->IntType, DL.getTypeAllocSize(type1));
+        CastInst *int64_address = new PtrToIntInst(pSecondArg, this->LongType, "", InsertBefore);
+        ConstantInt *const_id = ConstantInt::get(this->IntType, ID, true);
+        InlineSetRecord(int64_address, const_length, const_id, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookSampleRate(Value *rate, Instruction *InsertBefore)
+    {
+        assert(rate && InsertBefore);
+        CastInst *int64_rate = new ZExtInst(rate, this->LongType, "", InsertBefore);
+        InlineSetRecord(int64_rate, this->ConstantInt0, this->ConstantSampleWeight, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookAffine(Value *base, Value *tripCount, int stride, unsigned elemSize, int ID,
+                                         Instruction *InsertBefore)
+    {
+        assert(base && tripCount && InsertBefore);
+        assert(ID != 0 && stride != 0);
+
+        ConstantInt *const_stride = ConstantInt::get(this->IntType, stride, true);
+        InlineSetRecord(tripCount, const_stride, this->ConstantLoopAffine, InsertBefore);
+
+        ConstantInt *const_length = ConstantInt::get(this->IntType, elemSize);
+        CastInst *int64_address = new PtrToIntInst(base, this->LongType, "", InsertBefore);
+        ConstantInt *const_id = ConstantInt::get(this->IntType, ID, true);
+        InlineSetRecord(int64_address, const_length, const_id, InsertBefore);
+    }
+
+    void RecordEmitter::InlineHookLinkedList(Value *nodeCount, Value *occupied, unsigned nodeSize,
+                                             Instruction *InsertBefore)
+    {
+        assert(nodeCount && occupied && InsertBefore);
+        assert(nodeSize < (1U << (32 - LINKED_LIST_SIZE_SHIFT)));
+
+        ConstantInt *const_size = ConstantInt::get(this->IntType, nodeSize << LINKED_LIST_SIZE_SHIFT);
+        BinaryOperator *pLength = BinaryOperator::Create(Instruction::Or, occupied, const_size, "", InsertBefore);
+        InlineSetRecord(nodeCount, pLength, this->ConstantLoopLinkedList, InsertBefore);
+    }
+
+    void RecordEmitter::InlineAddIOBytes(Value *bytes, Instruction *InsertBefore)
+    {
+        LoadInst *pLoad = new LoadInst(this->IO_BYTES, "", false, InsertBefore);
+        pLoad->setAlignment(8);
+        BinaryOperator *pAdd = BinaryOperator::Create(Instruction::Add, pLoad, bytes, "IO_BYTES+=", InsertBefore);
+        auto pStore = new StoreInst(pAdd, this->IO_BYTES, false, InsertBefore);
+        pStore->setAlignment(8);
+    }
+
+    void RecordEmitter::InlineFlushIO(Instruction *InsertBefore)
+    {
+        // No branch: the record is written in any case, and overwritten by the next one if IO_BYTES is 0
+        LoadInst *pLoad = new LoadInst(this->IO_BYTES, "", false, InsertBefore);
+        pLoad->setAlignment(8);
+        ICmpInst *pKeep = new ICmpInst(InsertBefore, ICmpInst::ICMP_NE, pLoad, this->ConstantLong0);
+        InlineSetRecord(pLoad, this->ConstantInt0, this->ConstantIOSummary, InsertBefore, pKeep);
+        auto pStore = new StoreInst(this->ConstantLong0, this->IO_BYTES, false, InsertBefore);
+        pStore->setAlignment(8);
+    }
+
+    Instruction *RecordEmitter::GetInsertPointAfterCall(Instruction *pCall)
+    {
+        if (InvokeInst *pInvoke = dyn_cast<InvokeInst>(pCall))
+        {
+            BasicBlock *pNormal = pInvoke->getNormalDest();
+            if (!pNormal->getSinglePredecessor())
+            {
+                // hook the edge from the invoke only
+                pNormal = SplitEdge(pInvoke->getParent(), pNormal);
+            }
+            return &*pNormal->getFirstInsertionPt();
+        }
+        return pCall->getNextNode();
+    }
+
+    void RecordEmitter::InlineFlushIOAtLoopExits(Loop *pLoop)
+    {
+        // Exit blocks may be shared with the unsampled clone of the loop: flush on a block of their own.
+        // EH pads cannot be split, an exception leaves the bytes to the next delimiter.
+        SmallVector<BasicBlock *, 4> ExitBlocks;
+        pLoop->getUniqueExitBlocks(ExitBlocks);
+        for (BasicBlock *pExit : ExitBlocks)
+        {
+            if (pExit->isEHPad())
+            {
+                continue;
+            }
+            SmallVector<BasicBlock *, 4> vecPreds;
+            bool bShared = false;
+            for (auto it = pred_begin(pExit), et = pred_end(pExit); it != et; ++it)
+            {
+                if (!pLoop->contains(*it))
+                {
+                    bShared = true;
+                }
+                else if (std::find(vecPreds.begin(), vecPreds.end(), *it) == vecPreds.end())
+                {
+                    vecPreds.push_back(*it);
+                }
+            }
+            if (bShared)
+            {
+                pExit = SplitBlockPredecessors(pExit, vecPreds, ".flush");
+            }
+            InlineFlushIO(&*pExit->getFirstInsertionPt());
+        }
+    }
+
+    void RecordEmitter::InlineOutputCost(Instruction *InsertBefore)
+    {
+        InlineFlushIO(InsertBefore);
+        LoadInst *pLoad = new LoadInst(this->numGlobalCost, "", false, InsertBefore);
+        InlineSetRecord(pLoad, this->ConstantInt0, this->ConstantInt0, InsertBefore);
+    }
+
+    void RecordEmitter::RedirectThreadCreation()
+    {
+        // pthread_create_CPI(thread, attr, start, arg) opens the buffer of the new thread before start(arg)
+        Function *pCreate = this->pModule->getFunction("pthread_create");
+        if (!pCreate)
+        {
+            return;
+        }
+        Function *pCreateCPI = this->pModule->getFunction("pthread_create_CPI");
+        if (!pCreateCPI)
+        {
+            pCreateCPI = Function::Create(pCreate->getFunctionType(), GlobalValue::ExternalLinkage, "pthread_create_CPI",
+                                          this->pModule);
+            pCreateCPI->setCallingConv(CallingConv::C);
+        }
+        pCreate->replaceAllUsesWith(pCreateCPI);
+    }
+
+    void RecordEmitter::GuardThreadBuffers(Function *pMain)
+    {
+        // if (pcBuffer_CPI == NULL) InitForeignThreadMemHooks(); after the allocas of the entry block
+        MDNode *pUnlikely = MDBuilder(this->pModule->getContext()).createBranchWeights(1, 1000);
+        for (Function *F : this->setRecordFuncs)
+        {
+            if (F == pMain)
+            {
+                continue;
+            }
+            BasicBlock::iterator itInsert = F->getEntryBlock().getFirstInsertionPt();
+            while (isa<AllocaInst>(&*itInsert))
+            {
+                ++itInsert;
+            }
+            Instruction *pInsert = &*itInsert;
+            LoadInst *pLoad = new LoadInst(this->pcBuffer_CPI, "", false, pInsert);
+            pLoad->setAlignment(8);
+            ICmpInst *pNoBuffer = new ICmpInst(pInsert, ICmpInst::ICMP_EQ, pLoad, this->ConstantNULL, "");
+            TerminatorInst *pThen = SplitBlockAndInsertIfThen(pNoBuffer, pInsert, false, pUnlikely);
+            CallInst *pCall = CallInst::Create(this->InitForeignThreadMemHooks, "", pThen);
+            pCall->setCallingConv(CallingConv::C);
+            pCall->setTailCall(false);
+        }
+    }
+
+    void RecordEmitter::InstrumentMain(StringRef funcName)
+    {
+        AttributeList emptyList;
+
+        Function *pFunctionMain = this->pModule->getFunction(funcName);
+
+        if (!pFunctionMain)
+        {
+            errs() << "Cannot find the main function\n";
+            return;
+        }
+
+        if (this->Sink == PerThreadSink)
+        {
+            RedirectThreadCreation();
+            GuardThreadBuffers(pFunctionMain);
+        }
+
+        // Instrument to entry block
+        {
+            CallInst *pCall;
+            StoreInst *pStore;
+
+            // Location: before FirstNonPHI of main function.
+            Instruction *firstInst = pFunctionMain->getEntryBlock().getFirstNonPHI();
+
+            // Instrument InitMemHooks
+            pCall = CallInst::Create(this->InitMemHooks, "", firstInst);
+            pCall->setCallingConv(CallingConv::C);
+            pCall->setTailCall(false);
+            pCall->setAttributes(emptyList);
+
+            // Store to pcBuffer_CPI
+            pStore = new StoreInst(pCall, this->pcBuffer_CPI, false, firstInst);
+            pStore->setAlignment(8);
+
+            // Instrument getenv
+            std::vector<Value *> vecParam;
+            vecParam.push_back(SAMPLE_RATE_ptr);
+            pCall = CallInst::Create(this->getenv, vecParam, "", firstInst);
+            pCall->setCallingConv(CallingConv::C);
+            pCall->setTailCall(false);
+            AttributeList func_get_env_PAL;
+            {
+                SmallVector<AttributeList, 4> Attrs;
+                AttributeList PAS;
+                {
+                    AttrBuilder B;
+                    B.addAttribute(Attribute::NoUnwind);
+                    PAS = AttributeList::get(pModule->getContext(), ~0U, B);
+                }
+                Attrs.push_back(PAS);
+                func_get_env_PAL = AttributeList::get(pModule->getContext(), Attrs);
+            }
+            pCall->setAttributes(func_get_env_PAL);
+
+            // Instrument atoi
+            pCall = CallInst::Create(this->function_atoi, pCall, "", firstInst);
+            pCall->setCallingConv(CallingConv::C);
+            pCall->setTailCall(false);
+            AttributeList func_atoi_PAL;
+            {
+                SmallVector<AttributeList, 4> Attrs;
+                AttributeList PAS;
+                {
+                    AttrBuilder B;
+                    B.addAttribute(Attribute::NoUnwind);
+                    B.addAttribute(Attribute::ReadOnly);
+                    PAS = AttributeList::get(pModule->getContext(), ~0U, B);
+                }
+
+                Attrs.push_back(PAS);
+                func_atoi_PAL = AttributeList::get(pModule->getContext(), Attrs);
+            }
+            pCall->setAttributes(func_atoi_PAL);
+
+            // SAMPLE_RATE = atoi(getenv("SAMPLE_RATE"));
+            pStore = new StoreInst(pCall, SAMPLE_RATE, false, firstInst);
+            pStore->setAlignment(4);
+
+            // InitSampleControl(&SAMPLE_RATE, &SAMPLE_ENABLED);
+            if (this->bSampleControl)
+            {
+                std::vector<Value *> vecControlParam = {this->SAMPLE_RATE, this->SAMPLE_ENABLED};
+                pCall = CallInst::Create(this->InitSampleControl, vecControlParam, "", firstInst);
+                pCall->setCallingConv(CallingConv::C);
+                pCall->setTailCall(false);
+                pCall->setAttributes(emptyList);
+            }
+        }
+
+        CallInst *pCall;
+
+        for (auto &BB : *pFunctionMain)
+        {
+            for (auto &II : BB)
+            {
+                Instruction *pInst = &II;
+                // Instrument FinalizeMemHooks before return/unreachable/exit...
+                if (isa<ReturnInst>(pInst) || isExitInst(pInst))
+                {
+                    // Output numGlobalCost before exit.
+                    InlineOutputCost(pInst);
+
+                    auto pLoad = new LoadInst(this->iBufferIndex_CPI, "", false, pInst);
+                    pLoad->setAlignment(8);
+                    pCall = CallInst::Create(this->FinalizeMemHooks, pLoad, "", pInst);
+                    pCall->setCallingConv(CallingConv::C);
+                    pCall->setTailCall(false);
+                    pCall->setAttributes(emptyList);
+                }
+            }
+        }
+    }
+} // namespace common
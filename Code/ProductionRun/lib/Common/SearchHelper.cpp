@@ -3,12 +3,14 @@
 
 #include "Common/SearchHelper.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/InstIterator.h"
 #include <map>
 #include <set>
 #include <utility>
 #include "Common/IDHelper.h"
+#include "Common/IDIndex.h"
 
 using namespace llvm;
 
@@ -131,6 +133,32 @@ namespace common
         }
         return nullptr;
     }
+
+    void SearchIndirectCallees(const IDIndex &Index, const std::map<unsigned, std::set<unsigned>> &mapIndirectCalls,
+                               std::map<Instruction *, std::set<Function *>> &mapIndirectCallees)
+    {
+        for (const auto &kv : mapIndirectCalls)
+        {
+            Instruction *I = Index.getInstruction(kv.first);
+            if (!I || (!isa<CallInst>(I) && !isa<InvokeInst>(I)))
+            {
+                continue;
+            }
+            // Direct calls are in the table too
+            CallSite CS(I);
+            if (isa<Function>(CS.getCalledValue()->stripPointerCasts()))
+            {
+                continue;
+            }
+            for (unsigned FuncID : kv.second)
+            {
+                if (Function *Callee = Index.getFunction(FuncID))
+                {
+                    mapIndirectCallees[I].insert(Callee);
+                }
+            }
+        }
+    }
 } // namespace common
 
 #endif //PRODUCTIONRUN_SEARCHHELPER_H
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "LoopSampler/LoopSampleComp/LoopSampleComp.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Instructions.h"
+#include <algorithm>
 
 using namespace llvm;
 
@@ -322,6 +325,81 @@ namespace loopsampler
         return pElseBody;
     }
     
+    Value *LoopSampleComp::AdaptSampleRate(Loop *pInnerLoop, BasicBlock *pElseBody, Function *SampleBegin,
+                                           Function *SampleEnd)
+    {
+        CallInst *pGeo = nullptr;
+        for (Instruction &II : *pElseBody)
+        {
+            CallInst *pCall = dyn_cast<CallInst>(&II);
+            if (pCall && pCall->getCalledFunction() == this->geo)
+            {
+                pGeo = pCall;
+                break;
+            }
+        }
+        assert(pGeo);
+
+        CallInst *pRate = CallInst::Create(SampleBegin, pGeo->getArgOperand(0), "rate", pGeo);
+        pRate->setCallingConv(CallingConv::C);
+        pRate->setTailCall(false);
+        pGeo->setArgOperand(0, pRate);
+
+        // Exits are shared with the cloned loop: give the instrumented loop its own exit blocks.
+        // An exception leaving the loop skips SampleEnd (EH pads are shared with the unsampled clone),
+        // the next SampleBegin called from higher up the stack drops that sample from the measure.
+        SmallVector<BasicBlock *, 4> ExitBlocks;
+        pInnerLoop->getUniqueExitBlocks(ExitBlocks);
+        for (BasicBlock *pExit : ExitBlocks)
+        {
+            if (pExit->isEHPad())
+            {
+                continue;
+            }
+            SmallVector<BasicBlock *, 4> vecPreds;
+            for (auto it = pred_begin(pExit), et = pred_end(pExit); it != et; ++it)
+            {
+                if (pInnerLoop->contains(*it) && std::find(vecPreds.begin(), vecPreds.end(), *it) == vecPreds.end())
+                {
+                    vecPreds.push_back(*it);
+                }
+            }
+            BasicBlock *pSampledExit = SplitBlockPredecessors(pExit, vecPreds, ".sampled");
+            CallInst *pCall = CallInst::Create(SampleEnd, "", pSampledExit->getTerminator());
+            pCall->setCallingConv(CallingConv::C);
+            pCall->setTailCall(false);
+        }
+
+        return pRate;
+    }
+
+    void LoopSampleComp::GuardSampledPath(BasicBlock *pElseBody, BasicBlock *pClonedLoopHeader,
+                                          GlobalVariable *SAMPLE_ENABLED)
+    {
+        /*
+         * if (counter > 1) {
+         *     ...
+         * } else if (SAMPLE_ENABLED) {     // .sample.check
+         *     sampled
+         * } else {
+         *     goto cloned loop header;
+         * }
+         */
+        BasicBlock *pCondition1 = pElseBody->getSinglePredecessor();
+        assert(pCondition1);
+
+        BasicBlock *pCheck = BasicBlock::Create(pElseBody->getContext(), ".sample.check", pElseBody->getParent(),
+                                                pElseBody);
+        // Signal handlers switch it, keep the load at every execution
+        LoadInst *pLoad = new LoadInst(SAMPLE_ENABLED, "", true, pCheck);
+        pLoad->setAlignment(4);
+        ICmpInst *pCmp = new ICmpInst(*pCheck, ICmpInst::ICMP_NE, pLoad, ConstantInt::get(pLoad->getType(), 0),
+                                      "enabled");
+        BranchInst::Create(pElseBody, pClonedLoopHeader, pCmp, pCheck);
+
+        pCondition1->getTerminator()->replaceUsesOfWith(pElseBody, pCheck);
+    }
+
     void LoopSampleComp::RemapInstruction(Instruction *I, ValueToValueMapTy &VMap)
     {
         for (unsigned op = 0, E = I->getNumOperands(); op != E; ++op)
@@ -347,6 +425,31 @@ namespace loopsampler
         }
     }
 
+    /// if (callee of pCall == pOriginFunc) pClonedFunc(...) else pCall
+    static void PromoteIndirectCall(CallInst *pCall, Function *pOriginFunc, Function *pClonedFunc)
+    {
+        Value *pCalled = pCall->getCalledValue();
+        Constant *pOrigin = ConstantExpr::getBitCast(pOriginFunc, pCalled->getType());
+        ICmpInst *pCmp = new ICmpInst(pCall, ICmpInst::ICMP_EQ, pCalled, pOrigin, "icp.cmp");
+        TerminatorInst *pThenTerm = nullptr;
+        TerminatorInst *pElseTerm = nullptr;
+        SplitBlockAndInsertIfThenElse(pCmp, pCall, &pThenTerm, &pElseTerm);
+        BasicBlock *pTail = pCall->getParent();
+
+        CallInst *pDirect = cast<CallInst>(pCall->clone());
+        pDirect->setCalledFunction(ConstantExpr::getBitCast(pClonedFunc, pCalled->getType()));
+        pDirect->insertBefore(pThenTerm);
+        pCall->moveBefore(pElseTerm);
+
+        if (!pCall->getType()->isVoidTy())
+        {
+            PHINode *pPHI = PHINode::Create(pCall->getType(), 2, "", &pTail->front());
+            pCall->replaceAllUsesWith(pPHI);
+            pPHI->addIncoming(pDirect, pThenTerm->getParent());
+            pPHI->addIncoming(pCall, pElseTerm->getParent());
+        }
+    }
+
     void LoopSampleComp::CloneFunctions(std::set<Function *> &setFunc, ValueToValueMapTy &originClonedMapping)
     {
         for (Function *pOriginFunc : setFunc)
@@ -394,9 +497,18 @@ namespace loopsampler
                 auto itInst = originClonedMapping.find(pInst);
                 if (itInst != originClonedMapping.end())
                 {
+                    CallSite CS(pInst);
+                    bool isIndirect = !isa<Function>(CS.getCalledValue()->stripPointerCasts());
                     if (CallInst *pCall = dyn_cast<CallInst>(itInst->second))
                     {
-                        pCall->setCalledFunction(clonedFunc);
+                        if (isIndirect)
+                        {
+                            PromoteIndirectCall(pCall, pFunc, clonedFunc);
+                        }
+                        else
+                        {
+                            pCall->setCalledFunction(clonedFunc);
+                        }
                     }
                     else if (InvokeInst *pInvoke = dyn_cast<InvokeInst>(itInst->second))
                     {
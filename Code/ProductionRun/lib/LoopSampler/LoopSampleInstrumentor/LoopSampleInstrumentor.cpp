@@ -1,17 +1,28 @@
 #include "LoopSampler/LoopSampleInstrumentor/LoopSampleInstrumentor.h"
 
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 
+#include "Common/AffineAccess.h"
+#include "Common/AnalysisCache.h"
 #include "Common/Constants.h"
+#include "Common/IDHelper.h"
 #include "Common/MonitoredInsts.h"
 #include "Common/SearchHelper.h"
 #include "LoopSampler/LoopSampleComp/LoopSampleComp.h"
 
+#include <algorithm>
+#include <climits>
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <map>
 #include <set>
@@ -25,6 +36,9 @@ STATISTIC(NumOptRW, "Num of Optimized Read/Write Instrument Sites");
 STATISTIC(NumHoistRW, "Num of Hoisted Read/Write Instrument Sites");
 STATISTIC(NumNoOptCost, "Num of Non-optimized Cost Instrument Sites");
 STATISTIC(NumOptCost, "Num of Optimized Cost Instrument Sites");
+STATISTIC(NumSelectedLoops, "Num of Loops Instrumented in Whole-Program Mode");
+STATISTIC(NumInnerAffineRW, "Num of Read/Write Instrument Sites in Inner Loops Summarized at their Exit");
+STATISTIC(NumCachedFuncs, "Num of Functions whose Candidate Loops are Reused from the Analysis Cache");
 
 static RegisterPass<loopsampler::LoopSampleInstrumentor> X("opt-loop-instrument",
                                                            "instrument a loop with sampling",
@@ -55,13 +69,401 @@ namespace loopsampler
 
     static cl::opt<bool> bNoOptLoop("bNoOptLoop", cl::desc("No Opt for Loop"), cl::Optional, cl::value_desc("bNoOptLoop"));
 
+    static cl::opt<bool> bWholeProgram("wholeProgram", cl::desc("Instrument all Loops above the Cost Threshold"),
+                                       cl::Optional, cl::value_desc("bWholeProgram"));
+
+    static cl::opt<unsigned> uLoopCostThreshold("loopCostThreshold",
+                                                cl::desc("Min Static Cost of a Loop in Whole-Program Mode"),
+                                                cl::init(100), cl::Optional, cl::value_desc("uLoopCostThreshold"));
+
+    static cl::opt<std::string> strLoopListFile("loopList",
+                                                cl::desc("Candidate Loops, one <file> <func> <line> per line"),
+                                                cl::Optional, cl::value_desc("strLoopListFile"));
+
+    static cl::opt<std::string> strLoopIDFile("loopIDFile", cl::desc("Output: Loop ID to <file> <func> <line> <cost>"),
+                                              cl::init("loop_ids"), cl::Optional, cl::value_desc("strLoopIDFile"));
+
+    static cl::opt<std::string> strLoopProfile("loopProfile",
+                                               cl::desc("Branch Counts as <file>:<line> <count> (or br_rank.py output)"),
+                                               cl::Optional, cl::value_desc("strLoopProfile"));
+
+    static cl::opt<unsigned> uCloneBudget("cloneBudget",
+                                          cl::desc("Max Code Growth of Sampling Clones in % of the Module, 0: no limit"),
+                                          cl::init(0), cl::Optional, cl::value_desc("uCloneBudget"));
+
+    static cl::opt<std::string> strCloneReportFile("cloneReport",
+                                                   cl::desc("Output: Predicted Overhead and Coverage of the Clones"),
+                                                   cl::init("clone_report"), cl::Optional,
+                                                   cl::value_desc("strCloneReportFile"));
+
+    static cl::opt<bool> bAdaptiveRate("adaptiveRate",
+                                       cl::desc("Adapt SAMPLE_RATE at Runtime to COMAIR_OVERHEAD_BUDGET (% of Run Time)"),
+                                       cl::Optional, cl::value_desc("bAdaptiveRate"));
+
+    static cl::opt<bool> bSummarizeInner("summarizeInner",
+                                         cl::desc("Summarize the Affine Accesses of Inner Loops in the Sampled Loop"),
+                                         cl::Optional, cl::value_desc("bSummarizeInner"));
+
+    static cl::opt<std::string> strAnalysisCache("analysisCache",
+                                                 cl::desc("Candidate Loops of each Function, Reused across Runs "
+                                                          "while the Function is Unchanged"),
+                                                 cl::Optional, cl::value_desc("strAnalysisCache"));
+
+    /// Static cost of a loop: its instructions, each nested loop level weighting its body by 8
+    static unsigned long EstimateLoopCost(Loop *pLoop, LoopInfo &LPI)
+    {
+        unsigned long uCost = 0;
+        for (BasicBlock *BB : pLoop->blocks())
+        {
+            unsigned uDepth = LPI.getLoopDepth(BB) - pLoop->getLoopDepth();
+            uCost += BB->size() << (3 * std::min(uDepth, 4U));
+        }
+        return uCost;
+    }
+
+    static unsigned long CountInstructions(Function &F)
+    {
+        unsigned long uSize = 0;
+        for (BasicBlock &BB : F)
+        {
+            uSize += BB.size();
+        }
+        return uSize;
+    }
+
+    static std::string GetFileBaseName(StringRef strPath)
+    {
+        return strPath.substr(strPath.rfind('/') + 1).str();
+    }
+
+    /// Read branch counts: "<file>:<line> <count>" or br_rank.py lines "['<addr>', <count>, '<file>:<line>']".
+    /// Counts of the branches on one line add up, files are matched by base name.
+    static bool LoadLoopProfile(const std::string &strProfile, std::map<std::string, unsigned long> &mapLineCount)
+    {
+        std::ifstream ifsProfile(strProfile);
+        if (!ifsProfile.is_open())
+        {
+            return false;
+        }
+        std::string strLine;
+        while (std::getline(ifsProfile, strLine))
+        {
+            std::replace_if(strLine.begin(), strLine.end(), [](char c) {
+                return c == '[' || c == ']' || c == ',' || c == '\'';
+            }, ' ');
+            std::istringstream issLine(strLine);
+            std::vector<std::string> vecField;
+            std::string strField;
+            while (issLine >> strField)
+            {
+                vecField.push_back(strField);
+            }
+            std::string strLocation;
+            std::string strCount;
+            if (vecField.size() == 2)
+            {
+                strLocation = vecField[0];
+                strCount = vecField[1];
+            }
+            else if (vecField.size() == 3)
+            {
+                strLocation = vecField[2];
+                strCount = vecField[1];
+            }
+            else
+            {
+                continue;
+            }
+            size_t uColon = strLocation.rfind(':');
+            if (uColon == std::string::npos || strCount.find_first_not_of("0123456789") != std::string::npos)
+            {
+                continue;
+            }
+            mapLineCount[GetFileBaseName(strLocation.substr(0, uColon)) + strLocation.substr(uColon)] +=
+                std::stoul(strCount);
+        }
+        return true;
+    }
+
+    /// Hotness of a loop: the count of its most executed source line (usually the loop branch)
+    static unsigned long EstimateLoopHotness(const std::set<BasicBlock *> &setBlocks,
+                                             std::map<std::string, unsigned long> &mapLineCount)
+    {
+        unsigned long uHotness = 0;
+        for (BasicBlock *BB : setBlocks)
+        {
+            for (Instruction &II : *BB)
+            {
+                const DebugLoc &Loc = II.getDebugLoc();
+                if (!Loc)
+                {
+                    continue;
+                }
+                auto itCount = mapLineCount.find(GetFileBaseName(cast<DIScope>(Loc.getScope())->getFilename()) +
+                                                 ":" + std::to_string(Loc.getLine()));
+                if (itCount != mapLineCount.end())
+                {
+                    uHotness = std::max(uHotness, itCount->second);
+                }
+            }
+        }
+        return uHotness;
+    }
+
+    /// CloneInnerLoop and CreateIfElseBlock expect a simplified loop without address-taken blocks
+    static bool isSampleable(Loop *pLoop)
+    {
+        if (!pLoop->isLoopSimplifyForm())
+        {
+            return false;
+        }
+        for (BasicBlock *BB : pLoop->blocks())
+        {
+            if (BB->hasAddressTaken())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// The part of a candidate local to its function, the rest depends on the module or on the profile
+    static SelectedLoop SummarizeLoop(Loop *pLoop, LoopInfo &LPI)
+    {
+        SelectedLoop SL;
+        SL.pHeader = pLoop->getHeader();
+        SL.setBlocks.insert(pLoop->block_begin(), pLoop->block_end());
+        SL.uLoopID = 0;
+        SL.uCost = EstimateLoopCost(pLoop, LPI);
+        SL.StartLoc = pLoop->getStartLoc();
+        SL.uHotness = 0;
+        SL.uSize = 0;
+        SL.uGrowth = 0;
+        common::MonitoredRWInsts MI;
+        for (BasicBlock *BB : pLoop->blocks())
+        {
+            SL.uSize += BB->size();
+            for (Instruction &II : *BB)
+            {
+                MI.add(&II);
+            }
+        }
+        SL.uMonitored = MI.size();
+        return SL;
+    }
+
+    /// Summaries of the candidates of F by IDs, per loop: header, instruction carrying the start location
+    /// (INVALID_ID without one), cost, size, monitored accesses, number of blocks and blocks.
+    /// Return false if a summary cannot be referred to by IDs.
+    static bool EncodeCandidates(Function &F, const std::vector<SelectedLoop> &vecCandidate,
+                                 std::vector<unsigned long> &vecValues)
+    {
+        for (const SelectedLoop &SL : vecCandidate)
+        {
+            unsigned uStartLocID = common::INVALID_ID;
+            if (SL.StartLoc)
+            {
+                for (BasicBlock &BB : F)
+                {
+                    for (Instruction &II : BB)
+                    {
+                        if (uStartLocID == common::INVALID_ID && II.getDebugLoc() == SL.StartLoc)
+                        {
+                            uStartLocID = common::GetInstructionID(&II);
+                        }
+                    }
+                }
+                if (uStartLocID == common::INVALID_ID)
+                {
+                    return false;
+                }
+            }
+            unsigned uHeaderID = common::GetBasicBlockID(SL.pHeader);
+            if (uHeaderID == common::INVALID_ID)
+            {
+                return false;
+            }
+            vecValues.insert(vecValues.end(), {uHeaderID, uStartLocID, SL.uCost, SL.uSize, SL.uMonitored,
+                                               SL.setBlocks.size()});
+            for (BasicBlock *BB : SL.setBlocks)
+            {
+                unsigned uBBID = common::GetBasicBlockID(BB);
+                if (uBBID == common::INVALID_ID)
+                {
+                    return false;
+                }
+                vecValues.push_back(uBBID);
+            }
+        }
+        return true;
+    }
+
+    /// Inverse of EncodeCandidates, false if an ID no longer refers to F
+    static bool DecodeCandidates(Function &F, const common::IDIndex &Index, const std::vector<unsigned long> &vecValues,
+                                 std::vector<SelectedLoop> &vecCandidate)
+    {
+        auto getBlock = [&](unsigned long uBBID) -> BasicBlock * {
+            BasicBlock *BB = Index.getBasicBlock(uBBID);
+            return BB && BB->getParent() == &F ? BB : nullptr;
+        };
+        size_t i = 0;
+        while (i < vecValues.size())
+        {
+            if (i + 6 > vecValues.size())
+            {
+                return false;
+            }
+            SelectedLoop SL;
+            SL.pHeader = getBlock(vecValues[i]);
+            if (!SL.pHeader)
+            {
+                return false;
+            }
+            if (vecValues[i + 1] != common::INVALID_ID)
+            {
+                Instruction *pStartLocInst = Index.getInstruction(vecValues[i + 1]);
+                if (!pStartLocInst || pStartLocInst->getFunction() != &F)
+                {
+                    return false;
+                }
+                SL.StartLoc = pStartLocInst->getDebugLoc();
+            }
+            SL.uLoopID = 0;
+            SL.uCost = vecValues[i + 2];
+            SL.uHotness = 0;
+            SL.uSize = vecValues[i + 3];
+            SL.uGrowth = 0;
+            SL.uMonitored = vecValues[i + 4];
+            size_t uNumBlocks = vecValues[i + 5];
+            i += 6;
+            if (i + uNumBlocks > vecValues.size())
+            {
+                return false;
+            }
+            for (; uNumBlocks > 0; --uNumBlocks, ++i)
+            {
+                BasicBlock *BB = getBlock(vecValues[i]);
+                if (!BB)
+                {
+                    return false;
+                }
+                SL.setBlocks.insert(BB);
+            }
+            vecCandidate.push_back(SL);
+        }
+        return true;
+    }
+
     char LoopSampleInstrumentor::ID = 0;
 
+    void LoopSampleInstrumentor::getAnalysisUsage(AnalysisUsage &AU) const
+    {
+        LoopBaseInstrumentor::getAnalysisUsage(AU);
+        if (bSummarizeInner)
+        {
+            AU.addRequired<AAResultsWrapperPass>();
+            AU.addRequired<AssumptionCacheTracker>();
+            AU.addRequired<TargetLibraryInfoWrapperPass>();
+        }
+    }
+
+    unsigned LoopSampleInstrumentor::SummarizeInnerLoops(BasicBlock *pHeader, common::MonitoredRWInsts &MI)
+    {
+        Function *pFunction = pHeader->getParent();
+        // Analyses of the cloned function, the sampled copy keeps the original blocks.
+        // Each getAnalysis(F) re-runs the required passes on F and frees the AA/SE results of the previous run:
+        // AA last, SE built locally.
+        DominatorTree &DT = getAnalysis<DominatorTreeWrapperPass>(*pFunction).getDomTree();
+        LoopInfo &LPI = getAnalysis<LoopInfoWrapperPass>(*pFunction).getLoopInfo();
+        AliasAnalysis &AliasInfo = getAnalysis<AAResultsWrapperPass>(*pFunction).getAAResults();
+        std::unique_ptr<ScalarEvolution> pSE = common::BuildScalarEvolution(*this, *pFunction, DT, LPI);
+        ScalarEvolution &SE = *pSE;
+        Loop *pLoop = LPI.getLoopFor(pHeader);
+        assert(pLoop && pLoop->getHeader() == pHeader);
+
+        unsigned uSummarized = 0;
+        std::vector<Loop *> vecWorkList(pLoop->begin(), pLoop->end());
+        while (!vecWorkList.empty())
+        {
+            Loop *pInner = vecWorkList.back();
+            vecWorkList.pop_back();
+            vecWorkList.insert(vecWorkList.end(), pInner->begin(), pInner->end());
+
+            // A callee may write through the affine bases or change what the loop touches, as in InHouse
+            BasicBlock *pExit = pInner->getUniqueExitBlock();
+            if (!pExit || common::HasCallInLoop(pInner))
+            {
+                continue;
+            }
+            std::vector<common::AffineAccess> vecAffine;
+            const SCEV *TripCount = common::CollectAffineAccesses(pInner, SE, DT, AliasInfo, vecAffine);
+            if (!TripCount)
+            {
+                continue;
+            }
+
+            // Record {Start, elemSize, +ID} for a load, -ID for a store, as LoopArrayInstrumentor
+            std::vector<std::pair<common::AffineAccess, int>> vecSummary;
+            for (common::AffineAccess &AA : vecAffine)
+            {
+                if (LoadInst *pLoad = dyn_cast<LoadInst>(AA.pInst))
+                {
+                    auto It = MI.mapLoadID.find(pLoad);
+                    if (It != MI.mapLoadID.end())
+                    {
+                        vecSummary.push_back({AA, (int)It->second});
+                        MI.mapLoadID.erase(It);
+                    }
+                }
+                else if (StoreInst *pStore = dyn_cast<StoreInst>(AA.pInst))
+                {
+                    auto It = MI.mapStoreID.find(pStore);
+                    if (It != MI.mapStoreID.end())
+                    {
+                        vecSummary.push_back({AA, -(int)It->second});
+                        MI.mapStoreID.erase(It);
+                    }
+                }
+            }
+            if (vecSummary.empty())
+            {
+                continue;
+            }
+
+            // Start and tripcount are invariant in the inner loop, expand them in its preheader
+            SCEVExpander Expander(SE, pFunction->getParent()->getDataLayout(), "affine");
+            Instruction *pTerm = pInner->getLoopPreheader()->getTerminator();
+            Value *TripCountValue = Expander.expandCodeFor(TripCount, this->LongType, pTerm);
+            Instruction *ExitFirst = &*pExit->getFirstInsertionPt();
+            for (auto &Summary : vecSummary)
+            {
+                const common::AffineAccess &AA = Summary.first;
+                Value *Start = Expander.expandCodeFor(AA.Start, AA.Start->getType(), pTerm);
+                InlineHookAffine(Start, TripCountValue, AA.Stride, AA.ElemSize, Summary.second, ExitFirst);
+            }
+            uSummarized += vecSummary.size();
+        }
+
+        NumInnerAffineRW += uSummarized;
+        return uSummarized;
+    }
+
     bool LoopSampleInstrumentor::runOnModule(Module &M)
     {
         SetupInit(M);
+        Index.build(M);
+
+        if (!LoadIndirectCallees())
+        {
+            return false;
+        }
 
-        Function *pFunction = common::SearchFunctionByName(M, strFileName.c_str(), strFuncName.c_str(), uSrcLine);
+        if (bWholeProgram)
+        {
+            return InstrumentWholeProgram(M);
+        }
+
+        Function *pFunction = Index.searchFunction(strFileName.c_str(), strFuncName.c_str(), uSrcLine);
         if (!pFunction)
         {
             errs() << "Cannot find the function\n";
@@ -71,7 +473,7 @@ namespace loopsampler
         DominatorTree &DT = getAnalysis<DominatorTreeWrapperPass>(*pFunction).getDomTree();
         LoopInfo &LPI = getAnalysis<LoopInfoWrapperPass>(*pFunction).getLoopInfo();
 
-        Loop *pLoop = common::SearchLoopByLineNo(pFunction, &LPI, uSrcLine);
+        Loop *pLoop = Index.searchLoop(pFunction, &LPI, uSrcLine);
         if (!pLoop)
         {
             errs() << "Cannot find the loop\n";
@@ -104,6 +506,21 @@ namespace loopsampler
 
         BasicBlock *pLoopPreheader = LSC.CreateIfElseBlock(pLoop, pClonedLoopHeader);
         assert(pLoopPreheader);
+        if (this->SAMPLE_ENABLED)
+        {
+            LSC.GuardSampledPath(pLoopPreheader, pClonedLoopHeader, this->SAMPLE_ENABLED);
+        }
+        if (bAdaptiveRate)
+        {
+            Value *pRate = LSC.AdaptSampleRate(pLoop, pLoopPreheader, this->SampleBegin, this->SampleEnd);
+            InlineHookSampleRate(pRate, pLoopPreheader->getTerminator());
+        }
+        // SummarizeInnerLoops re-runs LoopInfo and frees pLoop: flush at its exits before
+        InlineFlushIOAtLoopExits(pLoop);
+        if (bSummarizeInner)
+        {
+            SummarizeInnerLoops(pLoop->getHeader(), MI);
+        }
 
         // Instrument Loop
         InstrumentMonitoredInsts(MI);
@@ -151,4 +568,401 @@ namespace loopsampler
 
         return false;
     }
-}
\ No newline at end of file
+
+    void LoopSampleInstrumentor::SelectLoops(Module &M, std::vector<SelectedLoop> &vecSelected)
+    {
+        std::vector<SelectedLoop> vecCandidate;
+        std::set<BasicBlock *> setCandidateHeader;
+
+        std::map<std::string, unsigned long> mapLineCount;
+        bool bProfile = strLoopProfile != "";
+        if (bProfile && !LoadLoopProfile(strLoopProfile, mapLineCount))
+        {
+            errs() << "Cannot open the loop profile " << strLoopProfile << "\n";
+            return;
+        }
+
+        // SL holds the summary of its loop, add its hotness and callees
+        auto insertCandidate = [&](SelectedLoop &SL) {
+            if (setCandidateHeader.find(SL.pHeader) != setCandidateHeader.end())
+            {
+                return;
+            }
+            SL.uHotness = bProfile ? EstimateLoopHotness(SL.setBlocks, mapLineCount) : 0;
+            std::map<Function *, std::set<Instruction *>> funcCallSiteMapping;
+            FindCalleesInDepth(SL.setBlocks, SL.setCallees, funcCallSiteMapping);
+            setCandidateHeader.insert(SL.pHeader);
+            vecCandidate.push_back(SL);
+        };
+        auto addCandidate = [&](Loop *pLoop, LoopInfo &LPI) {
+            if (setCandidateHeader.find(pLoop->getHeader()) != setCandidateHeader.end())
+            {
+                return;
+            }
+            SelectedLoop SL = SummarizeLoop(pLoop, LPI);
+            insertCandidate(SL);
+        };
+
+        if (strLoopListFile != "")
+        {
+            std::ifstream ifsLoopList(strLoopListFile);
+            if (!ifsLoopList.is_open())
+            {
+                errs() << "Cannot open the loop list " << strLoopListFile << "\n";
+                return;
+            }
+            std::string strFile;
+            std::string strFunc;
+            unsigned uLine;
+            while (ifsLoopList >> strFile >> strFunc >> uLine)
+            {
+                Function *pFunction = Index.searchFunction(strFile.c_str(), strFunc.c_str(), uLine);
+                if (!pFunction)
+                {
+                    errs() << "Cannot find the function " << strFunc << "\n";
+                    continue;
+                }
+                LoopInfo &LPI = getAnalysis<LoopInfoWrapperPass>(*pFunction).getLoopInfo();
+                Loop *pLoop = Index.searchLoop(pFunction, &LPI, uLine);
+                if (!pLoop || !isSampleable(pLoop) || EstimateLoopCost(pLoop, LPI) < uLoopCostThreshold)
+                {
+                    errs() << "Skip the loop " << strFile << ":" << uLine << "\n";
+                    continue;
+                }
+                addCandidate(pLoop, LPI);
+            }
+        }
+        else
+        {
+            // The candidates of a function only depend on it and on the threshold: reuse those of unchanged
+            // functions, hashed before any change to the IR
+            bool bCache = strAnalysisCache != "";
+            common::AnalysisCache Cache;
+            if (bCache)
+            {
+                Cache.load(strAnalysisCache);
+            }
+            std::string strCacheKey = "loopCandidates." + std::to_string(uLoopCostThreshold);
+            for (Function &F : M)
+            {
+                if (F.isDeclaration())
+                {
+                    continue;
+                }
+                std::vector<SelectedLoop> vecFuncCandidate;
+                const std::vector<unsigned long> *pCached = bCache ? Cache.lookup(F, strCacheKey) : nullptr;
+                if (pCached && DecodeCandidates(F, Index, *pCached, vecFuncCandidate))
+                {
+                    ++NumCachedFuncs;
+                }
+                else
+                {
+                    vecFuncCandidate.clear();
+                    // Take the outermost loops reaching the threshold, their inner loops are profiled with them
+                    LoopInfo &LPI = getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
+                    std::vector<Loop *> vecWorkList(LPI.begin(), LPI.end());
+                    while (!vecWorkList.empty())
+                    {
+                        Loop *pLoop = vecWorkList.back();
+                        vecWorkList.pop_back();
+                        if (isSampleable(pLoop) && EstimateLoopCost(pLoop, LPI) >= uLoopCostThreshold)
+                        {
+                            vecFuncCandidate.push_back(SummarizeLoop(pLoop, LPI));
+                            continue;
+                        }
+                        vecWorkList.insert(vecWorkList.end(), pLoop->begin(), pLoop->end());
+                    }
+                    std::vector<unsigned long> vecValues;
+                    if (bCache && EncodeCandidates(F, vecFuncCandidate, vecValues))
+                    {
+                        Cache.store(F, strCacheKey, std::move(vecValues));
+                    }
+                }
+                for (SelectedLoop &SL : vecFuncCandidate)
+                {
+                    insertCandidate(SL);
+                }
+            }
+            if (bCache && !Cache.save(strAnalysisCache))
+            {
+                errs() << "Cannot write the analysis cache " << strAnalysisCache << "\n";
+            }
+        }
+
+        // Without a profile prefer costly loops; with a profile prefer hot loops that clone little code
+        // (a loop clones its body and its callees), and ignore loops the profile never reached.
+        std::map<Function *, unsigned long> mapFuncSize;
+        unsigned long uModuleSize = 0;
+        for (Function &F : M)
+        {
+            mapFuncSize[&F] = CountInstructions(F);
+            uModuleSize += mapFuncSize[&F];
+        }
+        auto getCloneSize = [&](const SelectedLoop &SL) {
+            unsigned long uCloneSize = SL.uSize;
+            for (Function *pCallee : SL.setCallees)
+            {
+                uCloneSize += mapFuncSize[pCallee];
+            }
+            return uCloneSize;
+        };
+        if (bProfile)
+        {
+            std::stable_sort(vecCandidate.begin(), vecCandidate.end(), [&](const SelectedLoop &A, const SelectedLoop &B) {
+                return (double)A.uHotness / getCloneSize(A) > (double)B.uHotness / getCloneSize(B);
+            });
+        }
+        else
+        {
+            std::stable_sort(vecCandidate.begin(), vecCandidate.end(), [](const SelectedLoop &A, const SelectedLoop &B) {
+                return A.uCost > B.uCost;
+            });
+        }
+
+        // Records of a loop are delimited by its own sampled executions, so a selected loop must not run
+        // inside another one: drop the loops reachable from (or reaching) a selected loop.
+        unsigned long uBudget = uCloneBudget == 0 ? ULONG_MAX : uModuleSize * uCloneBudget / 100;
+        unsigned long uTotalGrowth = 0;
+        std::set<Function *> setLoopFunc;
+        std::set<Function *> setSelectedCallees;
+        std::vector<std::pair<SelectedLoop *, const char *>> vecSkipped;
+        for (SelectedLoop &SL : vecCandidate)
+        {
+            if (bProfile && SL.uHotness == 0)
+            {
+                vecSkipped.push_back({&SL, "cold"});
+                continue;
+            }
+
+            Function *pFunction = SL.pHeader->getParent();
+            bool bNested = setSelectedCallees.find(pFunction) != setSelectedCallees.end() ||
+                           SL.setCallees.find(pFunction) != SL.setCallees.end();
+            for (Function *pLoopFunc : setLoopFunc)
+            {
+                bNested |= SL.setCallees.find(pLoopFunc) != SL.setCallees.end();
+            }
+            // A listed inner loop of a selected loop (or the reverse) is sampled with the outermost one
+            for (SelectedLoop &Selected : vecSelected)
+            {
+                bNested |= Selected.setBlocks.count(SL.pHeader) != 0 || SL.setBlocks.count(Selected.pHeader) != 0;
+            }
+            if (bNested)
+            {
+                vecSkipped.push_back({&SL, "nested"});
+                continue;
+            }
+
+            // Callees already cloned for a selected loop are shared
+            SL.uGrowth = SL.uSize;
+            for (Function *pCallee : SL.setCallees)
+            {
+                if (setSelectedCallees.find(pCallee) == setSelectedCallees.end())
+                {
+                    SL.uGrowth += mapFuncSize[pCallee];
+                }
+            }
+            if (uTotalGrowth + SL.uGrowth > uBudget)
+            {
+                vecSkipped.push_back({&SL, "budget"});
+                continue;
+            }
+            uTotalGrowth += SL.uGrowth;
+
+            SL.uLoopID = vecSelected.size() + 1;
+            vecSelected.push_back(SL);
+            setLoopFunc.insert(pFunction);
+            setSelectedCallees.insert(SL.setCallees.begin(), SL.setCallees.end());
+        }
+
+        if (!bProfile && uCloneBudget == 0)
+        {
+            return;
+        }
+
+        /*
+         * Predicted overhead vs coverage:
+         *  coverage: profiled loop branches executed in the selected loops / in all candidate loops
+         *  growth: instructions cloned (loop bodies and their callees) / instructions in the module
+         *  records: hotness * monitored accesses of the selected loops, to divide by SAMPLE_RATE
+         */
+        std::ofstream ofsReport(strCloneReportFile);
+        unsigned long uAllHotness = 0;
+        unsigned long uSelectedHotness = 0;
+        unsigned long uRecords = 0;
+        for (SelectedLoop &SL : vecCandidate)
+        {
+            uAllHotness += SL.uHotness;
+        }
+        auto printLoop = [&](const SelectedLoop &SL) {
+            if (DILocation *pLoc = SL.StartLoc.get())
+            {
+                ofsReport << pLoc->getFilename().str() << ":" << pLoc->getLine();
+            }
+            else
+            {
+                ofsReport << "?";
+            }
+            ofsReport << " " << SL.pHeader->getParent()->getName().str() << " hotness " << SL.uHotness << " size "
+                      << SL.uSize << " callees " << SL.setCallees.size() << " monitored " << SL.uMonitored;
+        };
+        for (SelectedLoop &SL : vecSelected)
+        {
+            uSelectedHotness += SL.uHotness;
+            uRecords += SL.uHotness * SL.uMonitored;
+            ofsReport << "loop " << SL.uLoopID << " ";
+            printLoop(SL);
+            ofsReport << " growth " << SL.uGrowth << "\n";
+        }
+        for (auto &kv : vecSkipped)
+        {
+            ofsReport << "skip " << kv.second << " ";
+            printLoop(*kv.first);
+            ofsReport << "\n";
+        }
+        ofsReport << "coverage " << (uAllHotness == 0 ? 0 : uSelectedHotness * 100 / uAllHotness) << "%\n";
+        ofsReport << "growth " << uTotalGrowth << "/" << uModuleSize << " instructions ("
+                  << (uModuleSize == 0 ? 0 : uTotalGrowth * 100 / uModuleSize) << "%, budget "
+                  << uCloneBudget << "%)\n";
+        ofsReport << "records " << uRecords << "/SAMPLE_RATE\n";
+    }
+
+    bool LoopSampleInstrumentor::InstrumentWholeProgram(Module &M)
+    {
+        std::vector<SelectedLoop> vecSelected;
+        SelectLoops(M, vecSelected);
+        if (vecSelected.empty())
+        {
+            errs() << "No loop reaches the cost threshold\n";
+            return false;
+        }
+
+        std::ofstream ofsLoopID(strLoopIDFile);
+        for (SelectedLoop &SL : vecSelected)
+        {
+            ofsLoopID << SL.uLoopID << " ";
+            if (DILocation *pLoc = SL.StartLoc.get())
+            {
+                ofsLoopID << pLoc->getFilename().str() << " ";
+            }
+            else
+            {
+                ofsLoopID << "? ";
+            }
+            ofsLoopID << SL.pHeader->getParent()->getName().str() << " " << SL.StartLoc.getLine() << " " << SL.uCost
+                      << "\n";
+        }
+
+        std::set<Function *> setCallees;
+        std::map<Function *, std::set<Instruction *>> funcCallSiteMapping;
+        ValueToValueMapTy CalleeVMap;
+
+        for (SelectedLoop &SL : vecSelected)
+        {
+            Function *pFunction = SL.pHeader->getParent();
+            // Re-run LoopInfo: loops selected earlier in the same function have been cloned
+            LoopInfo &LPI = getAnalysis<LoopInfoWrapperPass>(*pFunction).getLoopInfo();
+            Loop *pLoop = LPI.getLoopFor(SL.pHeader);
+            assert(pLoop && pLoop->getHeader() == SL.pHeader);
+
+            std::set<BasicBlock *> setBBInLoop(pLoop->blocks().begin(), pLoop->blocks().end());
+
+            common::MonitoredRWInsts MI;
+            for (BasicBlock *BB : setBBInLoop)
+            {
+                ++NumNoOptCost;
+                for (Instruction &II : *BB)
+                {
+                    MI.add(&II);
+                }
+            }
+            NumNoOptRW += MI.size();
+
+            // int numGlobalCounter.<LoopID> = 1;
+            GlobalVariable *pCounter = new GlobalVariable(M, this->IntType, false, GlobalValue::PrivateLinkage,
+                                                          this->ConstantInt1,
+                                                          "numGlobalCounter." + std::to_string(SL.uLoopID), nullptr,
+                                                          GetCounterTLSMode());
+            pCounter->setAlignment(4);
+
+            LoopSampleComp LSC(this->SAMPLE_RATE,
+                               pCounter,
+                               this->geo,
+                               this->ConstantInt1,
+                               this->ConstantIntN1);
+
+            ValueToValueMapTy VMap;
+            BasicBlock *pClonedLoopHeader = LSC.CloneInnerLoop(pLoop, VMap);
+            assert(pClonedLoopHeader);
+
+            BasicBlock *pLoopPreheader = LSC.CreateIfElseBlock(pLoop, pClonedLoopHeader);
+            assert(pLoopPreheader);
+            InlineHookLoopDelimit(SL.uLoopID, pLoopPreheader->getTerminator());
+            if (this->SAMPLE_ENABLED)
+            {
+                LSC.GuardSampledPath(pLoopPreheader, pClonedLoopHeader, this->SAMPLE_ENABLED);
+            }
+            if (bAdaptiveRate)
+            {
+                Value *pRate = LSC.AdaptSampleRate(pLoop, pLoopPreheader, this->SampleBegin, this->SampleEnd);
+                InlineHookSampleRate(pRate, pLoopPreheader->getTerminator());
+            }
+            // SummarizeInnerLoops re-runs LoopInfo and frees pLoop: flush at its exits before
+            InlineFlushIOAtLoopExits(pLoop);
+            if (bSummarizeInner)
+            {
+                SummarizeInnerLoops(SL.pHeader, MI);
+            }
+
+            InstrumentMonitoredInsts(MI);
+            InlineGlobalCostForLoop(setBBInLoop);
+
+            FindCalleesInDepth(setBBInLoop, setCallees, funcCallSiteMapping);
+            // Call sites of the unsampled clone are redirected to the cloned callees
+            for (BasicBlock *BB : setBBInLoop)
+            {
+                for (Instruction &II : *BB)
+                {
+                    CalleeVMap[&II] = VMap[&II];
+                }
+            }
+            ++NumSelectedLoops;
+        }
+
+        // Callees are shared by the selected loops: clone and instrument each once
+        LoopSampleComp LSC(this->SAMPLE_RATE,
+                           this->numGlobalCounter,
+                           this->geo,
+                           this->ConstantInt1,
+                           this->ConstantIntN1);
+        LSC.CloneFunctions(setCallees, CalleeVMap);
+        LSC.RemapFunctionCalls(setCallees, funcCallSiteMapping, CalleeVMap);
+
+        for (Function *Callee : setCallees)
+        {
+            common::MonitoredRWInsts CalleeMI;
+            for (BasicBlock &BB : *Callee)
+            {
+                ++NumNoOptCost;
+                for (Instruction &II : BB)
+                {
+                    CalleeMI.add(&II);
+                }
+            }
+            NumNoOptRW += CalleeMI.size();
+            NumOptRW += CalleeMI.size();
+            InstrumentMonitoredInsts(CalleeMI);
+            InlineGlobalCostForCallee(Callee);
+        }
+
+        if (strEntryFuncName != "")
+        {
+            InstrumentMain(strEntryFuncName);
+        }
+        else
+        {
+            InstrumentMain("main");
+        }
+
+        return true;
+    }
+}
@@ -1,8 +1,11 @@
 #include "ParseRecord.h"
 
+#include <math.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <unordered_set>
+#include <map>
 #include <set>
 #include <vector>
 #include <algorithm>
@@ -22,7 +25,18 @@ constexpr unsigned LOOP_BEGIN = INT_MAX - 1;
 constexpr unsigned LOOP_END = INT_MAX - 2;
 constexpr unsigned LOOP_STRIDE = INT_MAX - 3;
 constexpr unsigned LOOP_NEGATIVE_STRIDE = INT_MAX - 4;
+constexpr unsigned LOOP_AFFINE = INT_MAX - 5;
+constexpr unsigned SAMPLE_WEIGHT = INT_MAX - 6;
+constexpr unsigned LOOP_LINKED_LIST = INT_MAX - 7;
+constexpr unsigned IO_SUMMARY = INT_MAX - 8;
 constexpr unsigned MAX_ID = INT_MAX;
+constexpr unsigned COMPACT_LENGTH_SHIFT = 48;
+constexpr unsigned long COMPACT_LENGTH_EXTENDED = 0xFFFF;
+constexpr unsigned long COMPACT_ADDRESS_MASK = (1UL << COMPACT_LENGTH_SHIFT) - 1;
+constexpr unsigned LINKED_LIST_SIZE_SHIFT = 16;
+constexpr unsigned LINKED_LIST_BITMAP_BITS = 4096;
+
+RecordLayout recordLayout = FixedLayout;
 
 struct_stMemRecord record{0UL, 0U, INVALID_ID};
 
@@ -37,6 +51,86 @@ std::set<unsigned long> allDistinctAddr;  // Mi: i-1 Distinct First Load Address
 unsigned long sumOfMiCi = 0;
 unsigned long sumOfRi = 0;
 
+// Pending LOOP_AFFINE: the next access repeats affineTripCount times, affineStride bytes apart
+unsigned long affineTripCount = 0;
+int affineStride = 0;
+
+// Adaptive rate: {rate, 0, SAMPLE_WEIGHT} after a delimiter, the sample stands for rate executions.
+// Mi*Ci and Ri of a sample are weighted by its rate, equal rates cancel out in sumOfMiCi / sumOfRi
+unsigned long sampleWeight = 1UL;
+
+// Whole-program mode: {numGlobalCost, loopID, DELIMIT} starts a sample of loopID, the Mi/Ci state of the
+// other loops is parked here and the cost between two samples is charged to the first one
+struct LoopState {
+    std::set<unsigned long> allDistinctAddr;
+    unsigned long allIOFuncSize = 0;
+    unsigned long sumOfMiCi = 0;
+    unsigned long sumOfRi = 0;
+    unsigned long cost = 0;
+};
+std::map<unsigned, LoopState> mapLoopState;
+unsigned currentLoopID = 0;
+unsigned long currentLoopCost = 0;
+
+void setRecordLayout(RecordLayout layout) {
+    recordLayout = layout;
+}
+
+// Decode the record at pcBuffer + offset, advance offset to the next record
+static void nextRecord(const char *pcBuffer, unsigned long &offset, struct_stMemRecord &record) {
+    const char *pc = pcBuffer + offset;
+    if (recordLayout == FixedLayout) {
+        memcpy(&record, pc, sizeof(struct_stMemRecord));
+        offset += sizeof(struct_stMemRecord);
+        return;
+    }
+
+    unsigned long packed = 0UL;
+    memcpy(&packed, pc, sizeof(packed));
+    memcpy(&record.id, pc + sizeof(packed), sizeof(record.id));
+    record.address = packed & COMPACT_ADDRESS_MASK;
+    unsigned long length = packed >> COMPACT_LENGTH_SHIFT;
+    if (length == COMPACT_LENGTH_EXTENDED) {
+        memcpy(&record.length, pc + sizeof(packed) + sizeof(record.id), sizeof(record.length));
+        offset += 16;
+    } else {
+        record.length = (unsigned)length;
+        offset += 12;
+    }
+}
+
+// Insert the bytes of one access record (or of the accesses it summarizes) into oneLoopRecord
+static void insertAccess(const struct_stMemRecord *record, OneLoopRecordFlag flag) {
+    unsigned long repeat = 1UL;
+    long stride = 0L;
+    if (affineTripCount != 0UL) {
+        repeat = affineTripCount;
+        stride = affineStride;
+        affineTripCount = 0UL;
+    }
+    for (unsigned long i = 0; i < repeat; ++i) {
+        unsigned long address = record->address + i * stride;
+        for (unsigned long j = address; j < address + record->length; ++j) {
+            oneLoopRecord.insert({j, flag});
+        }
+    }
+}
+
+// Bytes read by a summarized linked-list traversal: the distinct nodes are estimated from the occupied bits of
+// the node bitmap (linear counting), a saturated bitmap falls back to the node count.
+// The node addresses are not logged, the bytes count as input without address as IO Functions do.
+static unsigned long linkedListSize(const struct_stMemRecord *record) {
+    unsigned long nodeCount = record->address;
+    unsigned occupied = record->length & ((1U << LINKED_LIST_SIZE_SHIFT) - 1);
+    unsigned nodeSize = record->length >> LINKED_LIST_SIZE_SHIFT;
+    unsigned long distinct = nodeCount;
+    if (occupied < LINKED_LIST_BITMAP_BITS) {
+        double estimate = -(double)LINKED_LIST_BITMAP_BITS * log(1.0 - (double)occupied / LINKED_LIST_BITMAP_BITS);
+        distinct = std::min(nodeCount, (unsigned long)(estimate + 0.5));
+    }
+    return distinct * nodeSize;
+}
+
 static void calcMiCi() {
 
     oneLoopDistinctAddr.clear();
@@ -52,7 +146,7 @@ static void calcMiCi() {
         allIOFuncSize = oneLoopIOFuncSize;
     }
 
-    sumOfMiCi += (allDistinctAddr.size() + allIOFuncSize) * (oneLoopDistinctAddr.size() + oneLoopIOFuncSize);
+    sumOfMiCi += sampleWeight * (allDistinctAddr.size() + allIOFuncSize) * (oneLoopDistinctAddr.size() + oneLoopIOFuncSize);
 
     DEBUG_PRINT(
             ("sumOfMiCi: %lu, Mi: %lu+%lu, Ci: %lu+%lu\n", sumOfMiCi, allDistinctAddr.size(), allIOFuncSize, oneLoopDistinctAddr.size(), oneLoopIOFuncSize));
@@ -60,7 +154,7 @@ static void calcMiCi() {
     intersect.clear();
     std::set_intersection(allDistinctAddr.begin(), allDistinctAddr.end(), oneLoopDistinctAddr.begin(),
                           oneLoopDistinctAddr.end(), std::inserter(intersect, intersect.begin()));
-    sumOfRi += intersect.size();
+    sumOfRi += sampleWeight * intersect.size();
 
     DEBUG_PRINT(("sumOfRi: %lu, Ri: %lu\n", sumOfRi, intersect.size()));
 
@@ -71,6 +165,29 @@ static void calcMiCi() {
     oneLoopIOFuncSize = 0;
 }
 
+static void switchLoop(unsigned loopID, unsigned long cost) {
+    if (currentLoopID != 0) {
+        LoopState &current = mapLoopState[currentLoopID];
+        current.allDistinctAddr = std::move(allDistinctAddr);
+        current.allIOFuncSize = allIOFuncSize;
+        current.sumOfMiCi = sumOfMiCi;
+        current.sumOfRi = sumOfRi;
+        current.cost += cost - currentLoopCost;
+    }
+    allDistinctAddr.clear();
+
+    currentLoopID = loopID;
+    currentLoopCost = cost;
+    if (loopID == 0) {
+        return;
+    }
+    LoopState &next = mapLoopState[loopID];
+    allDistinctAddr = std::move(next.allDistinctAddr);
+    allIOFuncSize = next.allIOFuncSize;
+    sumOfMiCi = next.sumOfMiCi;
+    sumOfRi = next.sumOfRi;
+}
+
 static void calcUniqAddr() {
     oneLoopDistinctAddr.clear();
     for (auto &kv : oneLoopRecord) {
@@ -93,15 +210,17 @@ void parseRecordNoSample(char *pcBuffer) {
        return; 
     }
 
-    struct_stMemRecord *records = (struct_stMemRecord *)pcBuffer;
+    unsigned long offset = 0UL;
+    struct_stMemRecord current{0UL, 0U, INVALID_ID};
 
     int stride = 0;
     unsigned long arrayBeginAddress = 0UL;
     unsigned arrayBeginLength = 0U;
     bool endFlag = false;
     // Start from 1 to skip the first Delimiter
-    for (unsigned long i = 0; !endFlag; ++i) {
-        struct_stMemRecord *record = &records[i];
+    while (!endFlag) {
+        nextRecord(pcBuffer, offset, current);
+        struct_stMemRecord *record = &current;
         DEBUG_PRINT(("%lu, %u, %d\n", record->address, record->length, record->id));
 
         if (record->id == INVALID_ID) {
@@ -121,6 +240,16 @@ void parseRecordNoSample(char *pcBuffer) {
         } else if (record->id == DELIMIT) {
             calcUniqAddr();
             DEBUG_PRINT(("allDistinctAddr: %lu\n", allDistinctAddr.size()));
+        } else if (record->id == SAMPLE_WEIGHT) {
+            // every execution is recorded
+        } else if (record->id == LOOP_LINKED_LIST) {
+            oneLoopIOFuncSize += linkedListSize(record);
+        } else if (record->id == IO_SUMMARY) {
+            oneLoopIOFuncSize += record->address;
+        } else if (record->id == LOOP_AFFINE) {
+            affineTripCount = record->address;
+            affineStride = (int)record->length;
+            assert(affineStride != 0);
         } else if (record->id == LOOP_STRIDE) {
             stride = (int)record->length;
             assert(stride > 0);
@@ -145,14 +274,10 @@ void parseRecordNoSample(char *pcBuffer) {
                 // IO Function update RMS
                 oneLoopIOFuncSize += record->length;
             } else {
-                for (unsigned long j = record->address; j < record->address+record->length; ++j) {
-                    oneLoopRecord.insert({j, OneLoopRecordFlag::FirstLoad});
-                }
+                insertAccess(record, OneLoopRecordFlag::FirstLoad);
             }
         } else {  // record.id < 0
-            for (unsigned long j = record->address; j < record->address+record->length; ++j) {
-                oneLoopRecord.insert({j, OneLoopRecordFlag::FirstStore});
-            }
+            insertAccess(record, OneLoopRecordFlag::FirstStore);
         }
     }
 }
@@ -163,12 +288,18 @@ void parseRecord(char *pcBuffer) {
         return;
     }
 
-    struct_stMemRecord *records = (struct_stMemRecord *)pcBuffer;
+    unsigned long offset = 0UL;
+    struct_stMemRecord current{0UL, 0U, INVALID_ID};
 
     bool endFlag = false;
-    // Start from 1 to skip the first Delimiter
-    for (unsigned long i = 1; !endFlag; ++i) {
-        struct_stMemRecord *record = &records[i];
+    // Skip the first Delimiter, unless it starts a sample of a loop
+    nextRecord(pcBuffer, offset, current);
+    if (current.id == DELIMIT && current.length != 0U) {
+        switchLoop(current.length, current.address);
+    }
+    while (!endFlag) {
+        nextRecord(pcBuffer, offset, current);
+        struct_stMemRecord *record = &current;
         DEBUG_PRINT(("%lu, %u, %d\n", record->address, record->length, record->id));
 
         if (record->id == INVALID_ID) {
@@ -184,26 +315,42 @@ void parseRecord(char *pcBuffer) {
 
             calcMiCi();
 
-            if (sumOfRi == 0) {
+            if (currentLoopID != 0) {
+                // loopID,rms,cost per loop
+                switchLoop(0, cost);
+                for (auto &kv : mapLoopState) {
+                    unsigned long rms = kv.second.sumOfRi == 0 ? 0 : kv.second.sumOfMiCi / kv.second.sumOfRi;
+                    printf("%u,%lu,%lu\n", kv.first, rms, kv.second.cost);
+                }
+            } else if (sumOfRi == 0) {
                 printf("%u,%lu\n", 0, cost);
             } else {
                 printf("%lu,%lu\n", sumOfMiCi / sumOfRi, cost);
             }
         } else if (record->id == DELIMIT) {
             calcMiCi();
+            if (record->length != 0U) {
+                switchLoop(record->length, record->address);
+            }
+        } else if (record->id == SAMPLE_WEIGHT) {
+            sampleWeight = record->address == 0UL ? 1UL : record->address;
+        } else if (record->id == LOOP_LINKED_LIST) {
+            oneLoopIOFuncSize += linkedListSize(record);
+        } else if (record->id == IO_SUMMARY) {
+            oneLoopIOFuncSize += record->address;
+        } else if (record->id == LOOP_AFFINE) {
+            affineTripCount = record->address;
+            affineStride = (int)record->length;
+            assert(affineStride != 0);
         } else if (record->id > 0) {
             if (record->address == 0UL) {
                 // IO Function update RMS
                 oneLoopIOFuncSize += record->length;
             } else {
-                for (unsigned long j = record->address; j < record->address+record->length; ++j) {
-                    oneLoopRecord.insert({j, OneLoopRecordFlag::FirstLoad});
-                }
+                insertAccess(record, OneLoopRecordFlag::FirstLoad);
             }
         } else {  // record.id < 0
-            for (unsigned long j = record->address; j < record->address+record->length; ++j) {
-                oneLoopRecord.insert({j, OneLoopRecordFlag::FirstStore});
-            }
+            insertAccess(record, OneLoopRecordFlag::FirstStore);
         }
     }
 }
@@ -213,9 +360,11 @@ void parseRecordDebug(char *pcBuffer) {
        fprintf(stderr, "NULL buffer\n");
        return; 
     }
-    struct_stMemRecord *records = (struct_stMemRecord *)pcBuffer;
-    for (unsigned long i = 0; ; ++i) {
-        struct_stMemRecord *curr = &records[i];
+    unsigned long offset = 0UL;
+    struct_stMemRecord current{0UL, 0U, INVALID_ID};
+    for (;;) {
+        nextRecord(pcBuffer, offset, current);
+        struct_stMemRecord *curr = &current;
         fprintf(stderr, "%lu, %u, %d\n", curr->address, curr->length, curr->id);
         if (curr->id == INVALID_ID) {
             break;
@@ -15,8 +15,16 @@ struct struct_stMemRecord {
     int id;
 };
 
+enum RecordLayout : unsigned {
+    FixedLayout = 0,    // struct_stMemRecord, 16 bytes
+    CompactLayout       // <{address | length << 48, id}>, 12 bytes, or 16 bytes with an int length;
+                        // addresses (and costs) are read back from their low 48 bits
+};
+
 typedef std::unordered_map<unsigned long, OneLoopRecordFlag> OneLoopRecordTy;
 
+void setRecordLayout(RecordLayout layout);
+
 void parseRecord(char *pcBuffer);
 void parseRecordNoSample(char *pcBuffer);
 void parseRecordDebug(char *pcBuffer);
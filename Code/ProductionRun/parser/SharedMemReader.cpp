@@ -12,13 +12,19 @@
 
 #include "ParseRecord.h"
 
-int openSharedMem(const char *sharedMemName, int &fd, char *&pcBuffer)
+int openSharedMem(const char *sharedMemName, int &fd, char *&pcBuffer, bool isFile)
 {
-#ifndef TODISK
-    fd = shm_open(sharedMemName, O_RDWR, 0777);
-#else
-    fd = open(sharedMemName, O_RDWR, 0777);
+#ifdef TODISK
+    isFile = true;
 #endif
+    if (isFile)
+    {
+        fd = open(sharedMemName, O_RDWR, 0777);
+    }
+    else
+    {
+        fd = shm_open(sharedMemName, O_RDWR, 0777);
+    }
     if (fd == -1)
     {
         fprintf(stderr, "open failed: %s\n", strerror(errno));
@@ -39,7 +45,7 @@ int openSharedMem(const char *sharedMemName, int &fd, char *&pcBuffer)
     return 0;
 }
 
-int closeSharedMem(const char *sharedMemName, int fd, bool clearData)
+int closeSharedMem(const char *sharedMemName, int fd, bool clearData, bool isFile)
 {
     if (clearData)
     {
@@ -48,13 +54,14 @@ int closeSharedMem(const char *sharedMemName, int fd, bool clearData)
             fprintf(stderr, "ftruncate failed: %s\n", strerror(errno));
             return errno;
         }
-#ifndef TODISK
-        if (shm_unlink(sharedMemName) == -1)
+#ifdef TODISK
+        isFile = true;
+#endif
+        if (!isFile && shm_unlink(sharedMemName) == -1)
         {
             fprintf(stderr, "shm_unlink failed: %s\n", strerror(errno));
             return errno;
         }
-#endif
     }
     if (close(fd) == -1)
     {
@@ -72,17 +79,54 @@ int main(int argc, char *argv[])
     static char g_LogFileName[] = "/mnt/d/newcomair_123456789";
 #endif
 
+    // Usage: ProdRunLogger [-c] [-f] [-s] [name]
+    //   -c: compact records (opt -record-format=compact)
+    //   -s: sampled records (LoopSampleInstrumentor), prints loopID,rms,cost per loop with -wholeProgram
+    //   -f: name is a file (opt -record-sink=file)
+    //   name: e.g. newcomair_123456789.<tid> (opt -record-sink=thread)
     char *sharedMemName = g_LogFileName;
+    bool isFile = false;
+    bool isSampled = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "cfs")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            setRecordLayout(CompactLayout);
+            break;
+        case 'f':
+            isFile = true;
+            break;
+        case 's':
+            isSampled = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c] [-f] [-s] [name]\n", argv[0]);
+            return EINVAL;
+        }
+    }
+    if (optind < argc)
+    {
+        sharedMemName = argv[optind];
+    }
+
     int fd = 0;
     char *pcBuffer = nullptr;
-    auto err = openSharedMem(sharedMemName, fd, pcBuffer);
+    auto err = openSharedMem(sharedMemName, fd, pcBuffer, isFile);
     if (err != 0)
     {
         return err;
     }
-    //parseRecord(pcBuffer);
-    parseRecordNoSample(pcBuffer);
+    if (isSampled)
+    {
+        parseRecord(pcBuffer);
+    }
+    else
+    {
+        parseRecordNoSample(pcBuffer);
+    }
     //parseRecordDebug(pcBuffer);
 
-    closeSharedMem(sharedMemName, fd);
+    closeSharedMem(sharedMemName, fd, false, isFile);
 }
\ No newline at end of file
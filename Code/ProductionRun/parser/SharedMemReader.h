@@ -7,8 +7,8 @@
 #define BUFFERSIZE ((1UL << 38))
 #endif
 
-int openSharedMem(const char *sharedMemName, int &fd, char *&pcBuffer);
+int openSharedMem(const char *sharedMemName, int &fd, char *&pcBuffer, bool isFile = false);
 
-int closeSharedMem(const char *sharedMemName, int fd, bool clearData = false);
+int closeSharedMem(const char *sharedMemName, int fd, bool clearData = false, bool isFile = false);
 
 #endif //NEWCOMAIR_DUMPMEM_SHAREDMEMREADER_H
@@ -0,0 +1,43 @@
+#ifndef PRODUCTIONRUN_RECURSIONSUMMARY_H
+#define PRODUCTIONRUN_RECURSIONSUMMARY_H
+
+/**
+ * Summaries of the invocations of a recursive function (RecursiveInstrumentor -bSummary).
+ * Each invocation keeps a RECURSIONBITMAPBITS bitmap of the hashed 8-byte words read by it and its recursive
+ * calls; the instrumented code sets the bit of each load inline through pRecursionBitmap, without calls.
+ * At its exit <func_id, input, cost, depth> enters a reservoir of its depth and thread, the input being the
+ * distinct words estimated from the occupied bits (linear counting) times 8, and its bitmap is merged into
+ * the caller's. At process exit the reservoirs of all threads are merged and written to COMAIR_RECURSION_LOG
+ * (default recursion_summary.csv) as func_id,rms,cost,depth lines, the input of scripts/fitting.
+ */
+
+// must match common::RECURSION_BITMAP_BITS of the instrumentor
+#define RECURSIONBITMAPBITS 4096
+#define RECURSIONBITMAPSHIFT 12
+
+/**
+ * The bitmap of the current invocation. A read of the 8-byte word w = address >> 3 sets the bit
+ * h >> (64 - RECURSIONBITMAPSHIFT), h = ((w * C) ^ (w * C >> 32)) * C with C = 0x9E3779B97F4A7C15:
+ * one multiplication (Fibonacci hashing) spreads consecutive words too evenly for linear counting.
+ */
+extern __thread unsigned long *pRecursionBitmap;
+
+/**
+ * Enter an invocation of the recursive function.
+ * @param uFuncID the function ID.
+ * @param ulCost numGlobalCost at the entry.
+ */
+void RecursionEnter(unsigned uFuncID, unsigned long ulCost);
+
+/**
+ * Read the ulLength bytes at ulAddress in the current invocation (memory transfers).
+ */
+void RecursionReadRange(unsigned long ulAddress, unsigned long ulLength);
+
+/**
+ * Exit the current invocation, record its summary and merge its reads into the caller invocation.
+ * @param ulCost numGlobalCost at the exit.
+ */
+void RecursionExit(unsigned long ulCost);
+
+#endif //PRODUCTIONRUN_RECURSIONSUMMARY_H
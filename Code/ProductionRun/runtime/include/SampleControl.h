@@ -0,0 +1,19 @@
+#ifndef PRODUCTIONRUN_SAMPLECONTROL_H
+#define PRODUCTIONRUN_SAMPLECONTROL_H
+
+// the same start/stop signals as the pin tool (scripts/pin/branch.cpp)
+#define CT_START_SIG 60
+#define CT_STOP_SIG 61
+// the new SAMPLE_RATE is the value of the signal: kill -s 62 -q <rate> <pid> (util-linux), or sigqueue
+#define CT_RATE_SIG 62
+
+/**
+ * Let signals switch sampling on (CT_START_SIG) and off (CT_STOP_SIG) and change SAMPLE_RATE (CT_RATE_SIG).
+ * Sampling starts off if COMAIR_SAMPLE_ENABLED is 0.
+ * While it is off, the instrumented loops run their uninstrumented clones.
+ * @param piSampleRate SAMPLE_RATE of the instrumented module.
+ * @param piSampleEnabled SAMPLE_ENABLED of the instrumented module.
+ */
+void InitSampleControl(int *piSampleRate, int *piSampleEnabled);
+
+#endif //PRODUCTIONRUN_SAMPLECONTROL_H
@@ -0,0 +1,22 @@
+#ifndef PRODUCTIONRUN_SAMPLERATE_H
+#define PRODUCTIONRUN_SAMPLERATE_H
+
+/**
+ * Start a sampled execution, return the rate to draw the next counter with: geo(SampleBegin(SAMPLE_RATE)).
+ * The rate starts at iRate and is adapted once per window so that sampled executions take at most
+ * COMAIR_OVERHEAD_BUDGET percent (default 2) of the run time, it never drops below iRate.
+ * A new iRate (SAMPLE_RATE changed by SampleControl) restarts the adaptation from it.
+ * @param iRate SAMPLE_RATE.
+ * @return the rate in effect, logged with the sample so the parser can weight it.
+ */
+int SampleBegin(int iRate);
+
+/**
+ * End the sampled execution started by the last SampleBegin of the current thread.
+ * Nested sampled executions are timed once, by the outermost one.
+ * An execution left by an exception or longjmp misses its SampleEnd: the next SampleBegin called from higher up
+ * the stack than its own SampleBegin drops it from the measure.
+ */
+void SampleEnd();
+
+#endif //PRODUCTIONRUN_SAMPLERATE_H
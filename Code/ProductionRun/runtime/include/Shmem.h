@@ -13,4 +13,16 @@ char* InitMemHooks();
  */
 void FinalizeMemHooks(unsigned long iBufferIndex);
 
+/**
+ * Open a file (COMAIR_LOG_FILE or /mnt/d/newcomair_123456789) to store results, provide a ptr->buffer to operate on.
+ * @return ptr to the mmap-ed file.
+ */
+char* InitFileMemHooks();
+
+/**
+ * Truncate the file to the actual data size, then close.
+ * @param iBufferIndex curr index of the file buffer.
+ */
+void FinalizeFileMemHooks(unsigned long iBufferIndex);
+
 #endif //PRODUCTIONRUN_SHMEM_H
@@ -0,0 +1,48 @@
+#ifndef PRODUCTIONRUN_THREADSHMEM_H
+#define PRODUCTIONRUN_THREADSHMEM_H
+
+#include <pthread.h>
+
+/**
+ * Per-thread trace buffer of the current thread, written by the instrumented code.
+ */
+extern __thread char *pcBuffer_CPI;
+
+/**
+ * Per-thread index into pcBuffer_CPI.
+ */
+extern __thread long iBufferIndex_CPI;
+
+/**
+ * Cost of the current thread, written by the instrumented code (-record-sink=thread).
+ */
+extern __thread long numGlobalCost_CPI;
+
+/**
+ * Open the shared memory of the current thread: newcomair_123456789 for the main thread,
+ * newcomair_123456789.<tid> for the others.
+ * @return ptr to the shared mem buffer of the current thread.
+ */
+char* InitThreadMemHooks();
+
+/**
+ * Truncate the shared memory buffer of the current thread to the actual data size, then close.
+ * @param iBufferIndex curr index of the thread's shared mem buffer.
+ */
+void FinalizeThreadMemHooks(unsigned long iBufferIndex);
+
+/**
+ * Open the buffer of a thread started elsewhere (a library, std::thread in another module), at the entry of the
+ * first instrumented function it runs, and close it when the thread exits.
+ * @return ptr to the shared mem buffer of the current thread.
+ */
+char *InitForeignThreadMemHooks();
+
+/**
+ * pthread_create replacement: the new thread opens its own buffer before start_routine,
+ * and closes it when it exits.
+ */
+int pthread_create_CPI(pthread_t *thread, const pthread_attr_t *attr,
+                       void *(*start_routine)(void *), void *arg);
+
+#endif //PRODUCTIONRUN_THREADSHMEM_H
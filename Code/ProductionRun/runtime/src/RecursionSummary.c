@@ -0,0 +1,292 @@
+//
+// Bounded summaries of recursions
+//
+
+#include "RecursionSummary.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECURSIONBITMAPWORDS (RECURSIONBITMAPBITS / 64)
+
+// summaries kept per depth, deeper invocations share the last reservoir
+#define RESERVOIRSIZE 128
+#define MAXDEPTHBUCKET 64
+
+// a memory transfer of more words sets every bit
+#define MAXRANGEWORDS (RECURSIONBITMAPBITS * 16UL)
+
+// the summary file, COMAIR_RECURSION_LOG overrides it
+static const char *g_SummaryFileName = "recursion_summary.csv";
+
+struct stFrame
+{
+    unsigned uFuncID;
+    unsigned long ulCost;
+    unsigned long aulBitmap[RECURSIONBITMAPWORDS];
+};
+
+struct stSummary
+{
+    unsigned uFuncID;
+    unsigned uDepth;
+    unsigned long ulInput;
+    unsigned long ulCost;
+};
+
+struct stReservoir
+{
+    unsigned long ulSeen;
+    // the summaries not written yet, only used at process exit
+    unsigned long ulKept;
+    struct stSummary aSummary[RESERVOIRSIZE];
+};
+
+// the reservoirs of one thread, merged with those of the other threads at process exit
+struct stThreadSummaries
+{
+    struct stReservoir aReservoir[MAXDEPTHBUCKET];
+    struct stThreadSummaries *pNext;
+};
+
+__thread unsigned long *pRecursionBitmap = NULL;
+
+// the invocations of the current thread, innermost last
+static __thread struct stFrame *pFrames = NULL;
+static __thread unsigned uNumFrames = 0;
+static __thread unsigned uMaxFrames = 0;
+static __thread unsigned long ulRandom = 0;
+static __thread struct stThreadSummaries *pThreadSummaries = NULL;
+
+// every thread that recorded a summary, the lock is only taken once per thread and at process exit
+static struct stThreadSummaries *pAllSummaries = NULL;
+static pthread_mutex_t mutexSummaries = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t onceSummary = PTHREAD_ONCE_INIT;
+
+static unsigned long Hash(unsigned long ulKey)
+{
+    // splitmix64 finalizer
+    ulKey += 0x9E3779B97F4A7C15UL;
+    ulKey = (ulKey ^ (ulKey >> 30)) * 0xBF58476D1CE4E5B9UL;
+    ulKey = (ulKey ^ (ulKey >> 27)) * 0x94D049BB133111EBUL;
+    return ulKey ^ (ulKey >> 31);
+}
+
+static unsigned long NextRandom()
+{
+    if (ulRandom == 0)
+    {
+        // not the address of ulRandom: its constant offsets overflow the TLS relocations
+        ulRandom = Hash((unsigned long)pthread_self());
+    }
+    // xorshift64
+    ulRandom ^= ulRandom << 13;
+    ulRandom ^= ulRandom >> 7;
+    ulRandom ^= ulRandom << 17;
+    return ulRandom;
+}
+
+// the bit of the 8-byte word ulWord, the same hashing as the instrumented reads
+static void BitmapSet(unsigned long *pBitmap, unsigned long ulWord)
+{
+    unsigned long ulHash = ulWord * 0x9E3779B97F4A7C15UL;
+    ulHash = (ulHash ^ (ulHash >> 32)) * 0x9E3779B97F4A7C15UL;
+    unsigned long ulIndex = ulHash >> (64 - RECURSIONBITMAPSHIFT);
+    pBitmap[ulIndex >> 6] |= 1UL << (ulIndex & 63);
+}
+
+// linear counting: the distinct words hashed into the bitmap, bounded by ln(m) * m once every bit is set
+static unsigned long BitmapEstimate(const unsigned long *pBitmap)
+{
+    unsigned uOccupied = 0;
+    unsigned i;
+    for (i = 0; i < RECURSIONBITMAPWORDS; ++i)
+    {
+        uOccupied += __builtin_popcountl(pBitmap[i]);
+    }
+    if (uOccupied >= RECURSIONBITMAPBITS)
+    {
+        return (unsigned long)(RECURSIONBITMAPBITS * log((double)RECURSIONBITMAPBITS));
+    }
+    return (unsigned long)(-(double)RECURSIONBITMAPBITS * log(1.0 - (double)uOccupied / RECURSIONBITMAPBITS) + 0.5);
+}
+
+// the n-th summary of a reservoir replaces a random one with probability RESERVOIRSIZE / n
+static void ReservoirAdd(struct stReservoir *pReservoir, const struct stSummary *pSummary)
+{
+    unsigned long ulSeen = pReservoir->ulSeen++;
+    if (ulSeen < RESERVOIRSIZE)
+    {
+        pReservoir->aSummary[ulSeen] = *pSummary;
+        return;
+    }
+    unsigned long ulSlot = NextRandom() % (ulSeen + 1);
+    if (ulSlot < RESERVOIRSIZE)
+    {
+        pReservoir->aSummary[ulSlot] = *pSummary;
+    }
+}
+
+// draw RESERVOIRSIZE summaries of one depth from the reservoirs of all threads, each weighted by what it saw
+static void WriteDepth(FILE *pFile, unsigned uBucket)
+{
+    unsigned long ulTotal = 0;
+    struct stThreadSummaries *pThread;
+    for (pThread = pAllSummaries; pThread != NULL; pThread = pThread->pNext)
+    {
+        struct stReservoir *pReservoir = &pThread->aReservoir[uBucket];
+        pReservoir->ulKept = pReservoir->ulSeen < RESERVOIRSIZE ? pReservoir->ulSeen : RESERVOIRSIZE;
+        ulTotal += pReservoir->ulSeen;
+    }
+    unsigned uWritten;
+    for (uWritten = 0; uWritten < RESERVOIRSIZE && ulTotal > 0; ++uWritten)
+    {
+        unsigned long ulPick = NextRandom() % ulTotal;
+        for (pThread = pAllSummaries; pThread != NULL; pThread = pThread->pNext)
+        {
+            struct stReservoir *pReservoir = &pThread->aReservoir[uBucket];
+            if (ulPick >= pReservoir->ulSeen)
+            {
+                ulPick -= pReservoir->ulSeen;
+                continue;
+            }
+            // the kept summaries stand for the ulSeen of the thread, take one of them without replacement
+            unsigned long ulSlot = NextRandom() % pReservoir->ulKept;
+            struct stSummary *pSummary = &pReservoir->aSummary[ulSlot];
+            fprintf(pFile, "%u,%lu,%lu,%u\n", pSummary->uFuncID, pSummary->ulInput, pSummary->ulCost,
+                    pSummary->uDepth);
+            pReservoir->aSummary[ulSlot] = pReservoir->aSummary[--pReservoir->ulKept];
+            if (pReservoir->ulKept == 0)
+            {
+                // nothing left to stand for the rest of the thread
+                ulTotal -= pReservoir->ulSeen;
+                pReservoir->ulSeen = 0;
+            }
+            else
+            {
+                --ulTotal;
+                --pReservoir->ulSeen;
+            }
+            break;
+        }
+    }
+}
+
+static void WriteSummaries()
+{
+    const char *pcFileName = getenv("COMAIR_RECURSION_LOG");
+    if (pcFileName == NULL)
+    {
+        pcFileName = g_SummaryFileName;
+    }
+    FILE *pFile = fopen(pcFileName, "w");
+    if (pFile == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", pcFileName);
+        return;
+    }
+    fprintf(pFile, "func_id,rms,cost,depth\n");
+    pthread_mutex_lock(&mutexSummaries);
+    unsigned i;
+    for (i = 0; i < MAXDEPTHBUCKET; ++i)
+    {
+        WriteDepth(pFile, i);
+    }
+    pthread_mutex_unlock(&mutexSummaries);
+    fclose(pFile);
+}
+
+static void InitSummaries()
+{
+    atexit(WriteSummaries);
+}
+
+void RecursionEnter(unsigned uFuncID, unsigned long ulCost)
+{
+    if (pThreadSummaries == NULL)
+    {
+        pthread_once(&onceSummary, InitSummaries);
+        pThreadSummaries = (struct stThreadSummaries *)calloc(1, sizeof(struct stThreadSummaries));
+        if (pThreadSummaries == NULL)
+        {
+            fprintf(stderr, "Out of memory for the recursion summaries\n");
+            exit(-1);
+        }
+        pthread_mutex_lock(&mutexSummaries);
+        pThreadSummaries->pNext = pAllSummaries;
+        pAllSummaries = pThreadSummaries;
+        pthread_mutex_unlock(&mutexSummaries);
+    }
+    if (uNumFrames == uMaxFrames)
+    {
+        uMaxFrames = uMaxFrames == 0 ? 64 : uMaxFrames * 2;
+        pFrames = (struct stFrame *)realloc(pFrames, uMaxFrames * sizeof(struct stFrame));
+        if (pFrames == NULL)
+        {
+            fprintf(stderr, "Out of memory for %u recursion frames\n", uMaxFrames);
+            exit(-1);
+        }
+    }
+    struct stFrame *pFrame = &pFrames[uNumFrames++];
+    pFrame->uFuncID = uFuncID;
+    pFrame->ulCost = ulCost;
+    memset(pFrame->aulBitmap, 0, sizeof(pFrame->aulBitmap));
+    pRecursionBitmap = pFrame->aulBitmap;
+}
+
+void RecursionReadRange(unsigned long ulAddress, unsigned long ulLength)
+{
+    if (uNumFrames == 0 || ulLength == 0)
+    {
+        return;
+    }
+    unsigned long *pBitmap = pFrames[uNumFrames - 1].aulBitmap;
+    unsigned long ulFirst = ulAddress >> 3;
+    unsigned long ulLast = (ulAddress + ulLength - 1) >> 3;
+    if (ulLast - ulFirst >= MAXRANGEWORDS)
+    {
+        memset(pBitmap, 0xff, sizeof(pFrames[0].aulBitmap));
+        return;
+    }
+    unsigned long ulWord;
+    for (ulWord = ulFirst; ulWord <= ulLast; ++ulWord)
+    {
+        BitmapSet(pBitmap, ulWord);
+    }
+}
+
+void RecursionExit(unsigned long ulCost)
+{
+    if (uNumFrames == 0)
+    {
+        return;
+    }
+    struct stFrame *pFrame = &pFrames[--uNumFrames];
+
+    struct stSummary summary;
+    summary.uFuncID = pFrame->uFuncID;
+    summary.uDepth = uNumFrames;
+    summary.ulInput = BitmapEstimate(pFrame->aulBitmap) * 8;
+    summary.ulCost = ulCost - pFrame->ulCost;
+    ReservoirAdd(&pThreadSummaries->aReservoir[uNumFrames < MAXDEPTHBUCKET ? uNumFrames : MAXDEPTHBUCKET - 1],
+                 &summary);
+
+    // the caller read what its callee read
+    if (uNumFrames > 0)
+    {
+        unsigned long *pCaller = pFrames[uNumFrames - 1].aulBitmap;
+        unsigned i;
+        for (i = 0; i < RECURSIONBITMAPWORDS; ++i)
+        {
+            pCaller[i] |= pFrame->aulBitmap[i];
+        }
+        pRecursionBitmap = pCaller;
+    }
+    else
+    {
+        pRecursionBitmap = NULL;
+    }
+}
@@ -0,0 +1,65 @@
+//
+// Switch sampling on/off and change the sampling rate by signals
+//
+
+#include "SampleControl.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// SAMPLE_RATE and SAMPLE_ENABLED of the instrumented module
+static volatile int *g_piSampleRate = NULL;
+static volatile int *g_piSampleEnabled = NULL;
+
+static void StartSigFunc(int signum, siginfo_t *info, void *context)
+{
+    *g_piSampleEnabled = 1;
+}
+
+static void StopSigFunc(int signum, siginfo_t *info, void *context)
+{
+    *g_piSampleEnabled = 0;
+}
+
+static void RateSigFunc(int signum, siginfo_t *info, void *context)
+{
+    if (info->si_value.sival_int > 0)
+    {
+        *g_piSampleRate = info->si_value.sival_int;
+    }
+}
+
+static void InstallHandler(int signum, void (*handler)(int, siginfo_t *, void *))
+{
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_sigaction = handler;
+    act.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    if (sigaction(signum, &act, NULL) == -1)
+    {
+        fprintf(stderr, "sigaction %d failed: %s\n", signum, strerror(errno));
+    }
+}
+
+/**
+ * Install the handlers of the control signals.
+ */
+void InitSampleControl(int *piSampleRate, int *piSampleEnabled)
+{
+    g_piSampleRate = piSampleRate;
+    g_piSampleEnabled = piSampleEnabled;
+
+    const char *pcEnabled = getenv("COMAIR_SAMPLE_ENABLED");
+    if (pcEnabled != NULL && atoi(pcEnabled) == 0)
+    {
+        *g_piSampleEnabled = 0;
+    }
+
+    InstallHandler(CT_START_SIG, StartSigFunc);
+    InstallHandler(CT_STOP_SIG, StopSigFunc);
+    InstallHandler(CT_RATE_SIG, RateSigFunc);
+}
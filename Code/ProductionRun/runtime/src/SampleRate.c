@@ -0,0 +1,161 @@
+//
+// Adaptive sampling rate
+//
+
+#include "SampleRate.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+// the overhead budget in percent of the run time, COMAIR_OVERHEAD_BUDGET overrides it
+#define DEFAULT_OVERHEAD_BUDGET 2.0
+
+// the rate is adapted at most once per window
+#define WINDOWNS (10UL * 1000 * 1000)
+
+// the rate changes by at most this factor per window
+#define MAXRATESTEP 2.0
+
+#define MAXRATE (1 << 30)
+
+// the overhead budget as a fraction of the run time
+static double dBudget = DEFAULT_OVERHEAD_BUDGET / 100;
+
+// SAMPLE_RATE, the densest rate
+static atomic_int iMinRate = 1;
+
+// the rate in effect, 0 before the first sample
+static atomic_int iCurrRate = 0;
+
+// the first SampleBegin sets up the controller
+static atomic_flag flagInit = ATOMIC_FLAG_INIT;
+
+// the start of the current window, and the time spent in sampled executions since then
+static atomic_ulong ulWindowBegin = 0;
+static atomic_ulong ulWindowSampled = 0;
+
+// the nesting of sampled executions in the current thread, and the start of the outermost one
+static __thread unsigned uDepth = 0;
+static __thread unsigned long ulSampleBegin = 0;
+
+// the stack frame of the SampleBegin of the outermost sampled execution (the stack grows down)
+static __thread void *pOuterFrame = NULL;
+
+static unsigned long NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+}
+
+static void InitRate(int iRate, unsigned long ulNow)
+{
+    const char *pcBudget = getenv("COMAIR_OVERHEAD_BUDGET");
+    if (pcBudget != NULL && atof(pcBudget) > 0)
+    {
+        dBudget = atof(pcBudget) / 100;
+    }
+    atomic_store(&iMinRate, iRate);
+    atomic_store(&ulWindowBegin, ulNow);
+    // publish the settings above
+    atomic_store(&iCurrRate, iRate);
+}
+
+/**
+ * Close the window if it is over: scale the rate by overhead / budget when the overhead is out of
+ * [budget / 2, budget], by at most MAXRATESTEP.
+ */
+static void AdaptRate(unsigned long ulNow)
+{
+    unsigned long ulBegin = atomic_load_explicit(&ulWindowBegin, memory_order_relaxed);
+    if (ulNow - ulBegin < WINDOWNS)
+    {
+        return;
+    }
+    // one thread closes the window
+    if (!atomic_compare_exchange_strong(&ulWindowBegin, &ulBegin, ulNow))
+    {
+        return;
+    }
+    unsigned long ulSampled = atomic_exchange(&ulWindowSampled, 0);
+    double dOverhead = (double)ulSampled / (double)(ulNow - ulBegin);
+    if (dOverhead <= dBudget && dOverhead >= dBudget / 2)
+    {
+        return;
+    }
+
+    double dScale = dOverhead / dBudget;
+    if (dScale > MAXRATESTEP)
+    {
+        dScale = MAXRATESTEP;
+    }
+    else if (dScale < 1 / MAXRATESTEP)
+    {
+        dScale = 1 / MAXRATESTEP;
+    }
+    double dRate = atomic_load(&iCurrRate) * dScale;
+    int iMin = atomic_load(&iMinRate);
+    if (dRate < iMin)
+    {
+        dRate = iMin;
+    }
+    else if (dRate > MAXRATE)
+    {
+        dRate = MAXRATE;
+    }
+    atomic_store(&iCurrRate, (int)dRate);
+}
+
+int SampleBegin(int iRate)
+{
+    unsigned long ulNow = NowNs();
+    void *pFrame = __builtin_frame_address(0);
+    // Called from above the frame of the outermost sampled execution: its function was left without SampleEnd
+    // (exception, longjmp). The end of that execution is unknown, drop it and start over from depth 0.
+    if (uDepth != 0 && pFrame > pOuterFrame)
+    {
+        uDepth = 0;
+    }
+    if (uDepth++ == 0)
+    {
+        ulSampleBegin = ulNow;
+        pOuterFrame = pFrame;
+    }
+
+    if (atomic_load(&iCurrRate) == 0)
+    {
+        if (iRate < 1)
+        {
+            iRate = 1;
+        }
+        if (!atomic_flag_test_and_set(&flagInit))
+        {
+            InitRate(iRate, ulNow);
+        }
+        // another thread is setting up the controller
+        return iRate;
+    }
+
+    // SAMPLE_RATE changed at runtime (SampleControl): start over from the new rate
+    if (iRate >= 1 && iRate != atomic_load_explicit(&iMinRate, memory_order_relaxed))
+    {
+        atomic_store(&iMinRate, iRate);
+        atomic_store(&iCurrRate, iRate);
+    }
+
+    AdaptRate(ulNow);
+    return atomic_load_explicit(&iCurrRate, memory_order_relaxed);
+}
+
+void SampleEnd()
+{
+    if (uDepth == 0)
+    {
+        return;
+    }
+    if (--uDepth == 0)
+    {
+        atomic_fetch_add_explicit(&ulWindowSampled, NowNs() - ulSampleBegin, memory_order_relaxed);
+    }
+}
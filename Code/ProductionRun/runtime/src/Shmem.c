@@ -29,9 +29,18 @@ static int fd = -1;
 #define BUFFERSIZE ((1UL << 38))
 #endif
 
+// the file sink, COMAIR_LOG_FILE overrides it
+static const char *g_DiskLogFileName = "/mnt/d/newcomair_123456789";
+
+// the buffer size of the file sink
+#define FILEBUFFERSIZE ((1UL << 38))
+
 // the ptr to buffer
 char *pcBuffer;
 
+// the mapped size of pcBuffer
+static unsigned long ulBufferSize = BUFFERSIZE;
+
 /**
  * Open a shared memory to store results, provide a ptr->buffer to operate on.
  */
@@ -61,12 +70,43 @@ char *InitMemHooks()
     return pcBuffer;
 }
 
+/**
+ * Open a file to store results, provide a ptr->buffer to operate on.
+ */
+char *InitFileMemHooks()
+{
+    const char *pcLogFileName = getenv("COMAIR_LOG_FILE");
+    if (pcLogFileName == NULL)
+    {
+        pcLogFileName = g_DiskLogFileName;
+    }
+    fd = open(pcLogFileName, O_RDWR | O_CREAT, 0777);
+    if (fd == -1)
+    {
+        fprintf(stderr, "open failed: %s\n", strerror(errno));
+        exit(-1);
+    }
+    ulBufferSize = FILEBUFFERSIZE;
+    if (ftruncate(fd, ulBufferSize) == -1)
+    {
+        fprintf(stderr, "ftruncate failed: %s\n", strerror(errno));
+        exit(-1);
+    }
+    pcBuffer = (char *)mmap(0, ulBufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (pcBuffer == MAP_FAILED)
+    {
+        fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+        exit(-1);
+    }
+    return pcBuffer;
+}
+
 /**
  * Truncate the shared memory buffer to the actual data size, then close.
  */
 void FinalizeMemHooks(unsigned long iBufferIndex)
 {
-    if (munmap(pcBuffer, BUFFERSIZE) == -1)
+    if (munmap(pcBuffer, ulBufferSize) == -1)
     {
         fprintf(stderr, "munmap failed: %s\n", strerror(errno));
         exit(-1);
@@ -77,4 +117,12 @@ void FinalizeMemHooks(unsigned long iBufferIndex)
         exit(-1);
     }
     close(fd);
-}
\ No newline at end of file
+}
+
+/**
+ * Truncate the file to the actual data size, then close.
+ */
+void FinalizeFileMemHooks(unsigned long iBufferIndex)
+{
+    FinalizeMemHooks(iBufferIndex);
+}
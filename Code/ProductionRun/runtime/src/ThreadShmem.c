@@ -0,0 +1,160 @@
+//
+// Per-thread shared memory
+//
+
+#include "ThreadShmem.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// the log file name of the main thread, other threads append .<tid>
+static const char *g_LogFileName = "newcomair_123456789";
+
+// the buffer size of the shared memory of one thread
+#define BUFFERSIZE ((1UL << 33))
+
+// the size of the end record of a created thread, covers both the fixed and the compact layout
+#define ENDRECORDSIZE 16
+
+__thread char *pcBuffer_CPI;
+__thread long iBufferIndex_CPI;
+__thread long numGlobalCost_CPI;
+
+// the file descriptor of the shared memory of the current thread
+static __thread int fd = -1;
+
+// finalize the buffer of a created thread when it exits, also on pthread_exit
+static pthread_key_t keyThreadBuffer;
+static pthread_once_t onceThreadBuffer = PTHREAD_ONCE_INIT;
+
+struct stThreadStart
+{
+    void *(*start_routine)(void *);
+    void *arg;
+};
+
+/**
+ * Open a shared memory to store results of the current thread.
+ */
+char *InitThreadMemHooks()
+{
+    char acLogFileName[64];
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    if (tid == getpid())
+    {
+        snprintf(acLogFileName, sizeof(acLogFileName), "%s", g_LogFileName);
+    }
+    else
+    {
+        snprintf(acLogFileName, sizeof(acLogFileName), "%s.%d", g_LogFileName, tid);
+    }
+
+    fd = shm_open(acLogFileName, O_RDWR | O_CREAT, 0777);
+    if (fd == -1)
+    {
+        fprintf(stderr, "open failed: %s\n", strerror(errno));
+        exit(-1);
+    }
+    if (ftruncate(fd, BUFFERSIZE) == -1)
+    {
+        fprintf(stderr, "ftruncate failed: %s\n", strerror(errno));
+        exit(-1);
+    }
+    pcBuffer_CPI = (char *)mmap(0, BUFFERSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (pcBuffer_CPI == MAP_FAILED)
+    {
+        fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+        exit(-1);
+    }
+    iBufferIndex_CPI = 0;
+    return pcBuffer_CPI;
+}
+
+/**
+ * Truncate the shared memory buffer of the current thread to the actual data size, then close.
+ */
+void FinalizeThreadMemHooks(unsigned long iBufferIndex)
+{
+    if (munmap(pcBuffer_CPI, BUFFERSIZE) == -1)
+    {
+        fprintf(stderr, "munmap failed: %s\n", strerror(errno));
+        exit(-1);
+    }
+    pcBuffer_CPI = NULL;
+    if (ftruncate(fd, iBufferIndex) == -1)
+    {
+        fprintf(stderr, "ftruncate failed: %s\n", strerror(errno));
+        exit(-1);
+    }
+    close(fd);
+    fd = -1;
+}
+
+/**
+ * Created threads do not return through main, end their buffer with the cost record {numGlobalCost_CPI, 0, 0}.
+ * The address field comes first in both layouts and the zeroed length and id cover both record sizes.
+ */
+static void FinalizeCreatedThread(void *pBuffer)
+{
+    if (pcBuffer_CPI == NULL)
+    {
+        return;
+    }
+    memset(pcBuffer_CPI + iBufferIndex_CPI, 0, ENDRECORDSIZE);
+    memcpy(pcBuffer_CPI + iBufferIndex_CPI, &numGlobalCost_CPI, sizeof(numGlobalCost_CPI));
+    FinalizeThreadMemHooks(iBufferIndex_CPI + ENDRECORDSIZE);
+}
+
+static void CreateThreadBufferKey()
+{
+    pthread_key_create(&keyThreadBuffer, FinalizeCreatedThread);
+}
+
+/**
+ * Open the buffer of a thread that did not start through pthread_create_CPI, closed when the thread exits.
+ */
+char *InitForeignThreadMemHooks()
+{
+    pthread_once(&onceThreadBuffer, CreateThreadBufferKey);
+    InitThreadMemHooks();
+    // a non-NULL value makes the key destructor run at thread exit
+    pthread_setspecific(keyThreadBuffer, pcBuffer_CPI);
+    return pcBuffer_CPI;
+}
+
+static void *StartThread(void *pStart)
+{
+    struct stThreadStart start = *(struct stThreadStart *)pStart;
+    free(pStart);
+
+    InitForeignThreadMemHooks();
+
+    return start.start_routine(start.arg);
+}
+
+/**
+ * Create a thread that records into its own shared memory buffer.
+ */
+int pthread_create_CPI(pthread_t *thread, const pthread_attr_t *attr,
+                       void *(*start_routine)(void *), void *arg)
+{
+    struct stThreadStart *pStart = (struct stThreadStart *)malloc(sizeof(struct stThreadStart));
+    if (pStart == NULL)
+    {
+        return ENOMEM;
+    }
+    pStart->start_routine = start_routine;
+    pStart->arg = arg;
+    int ret = pthread_create(thread, attr, StartThread, pStart);
+    if (ret != 0)
+    {
+        free(pStart);
+    }
+    return ret;
+}
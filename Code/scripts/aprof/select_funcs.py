@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""Select the functions to instrument from a profile-only in-house run.
+
+Stage 1: build with InHouseHookPass -profile-only (calls and costs, no RW hooks),
+run it and dump the records with InHouseLogger.
+Stage 2: build with InHouseHookPass -func-list-file func_list.
+
+Usage: ./select_funcs.py inhouse_results.csv cost_threshold [func_list]
+
+A function is selected if one of its invocations costs at least cost_threshold
+(the cost of an invocation includes its callees).
+
+Output:
+func_list: the selected function ids, one per line, by largest cost.
+The number of selected functions and their share of the calls.
+"""
+
+import sys
+
+def parse_inhouse_csv(inhouse_csv):
+    cost_results = {}
+    call_results = {}
+    with open(inhouse_csv) as infile:
+        for line in infile.readlines():
+            line = line.strip()
+            fields = line.split(',')
+            if len(fields) < 3:
+                continue
+            if not fields[0].isnumeric() or not fields[2].isnumeric():
+                continue
+            func_id = int(fields[0])
+            cost = int(fields[2])
+            cost_results[func_id] = max(cost_results.get(func_id, 0), cost)
+            call_results[func_id] = call_results.get(func_id, 0) + 1
+    return cost_results, call_results
+
+def select_funcs(inhouse_csv, cost_threshold, func_list):
+    cost_results, call_results = parse_inhouse_csv(inhouse_csv)
+    selected = [func_id for func_id, cost in cost_results.items() if cost >= cost_threshold]
+    selected.sort(key=lambda func_id: cost_results[func_id], reverse=True)
+    with open(func_list, "w") as outfile:
+        for func_id in selected:
+            outfile.write("{}\n".format(func_id))
+    num_calls = sum(call_results.values())
+    num_selected_calls = sum(call_results[func_id] for func_id in selected)
+    print("Selected:{}/{}".format(len(selected), len(cost_results)))
+    print("Calls:{}/{}".format(num_selected_calls, num_calls))
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print("Two arguments: inhouse_csv cost_threshold [func_list]")
+    else:
+        select_funcs(sys.argv[1], int(sys.argv[2]), sys.argv[3] if len(sys.argv) > 3 else "func_list")
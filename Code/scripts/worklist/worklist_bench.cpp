@@ -0,0 +1,66 @@
+// Callee discovery cost of OrdWorkList before and after it was backed by a SetVector.
+//
+// Build from this directory against LLVMSupport:
+//   g++ -O2 -std=c++14 -I../../ProductionRun/include -I`llvm-config --includedir` worklist_bench.cpp \
+//       -o worklist_bench `llvm-config --ldflags --libs support`
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "Common/WorkList.h"
+
+// OrdWorkList as it was: a std::find over every pushed element per push
+template<typename T>
+class OldOrdWorkList {
+    std::vector<T> stack;
+    std::vector<T> set;
+public:
+    bool push(T elem) {
+        if (std::find(this->set.begin(), this->set.end(), elem) == this->set.end()) {
+            this->set.push_back(elem);
+            this->stack.push_back(elem);
+            return true;
+        }
+        return false;
+    }
+
+    std::experimental::optional<T> pop() {
+        if (this->stack.empty()) {
+            return std::experimental::nullopt;
+        }
+        auto ret = this->stack.back();
+        this->stack.pop_back();
+        return std::experimental::optional<T>(ret);
+    }
+};
+
+// push every callee 4 times in a scattered order, as repeated call sites do, then drain the list
+template<typename W>
+double run(std::vector<int> &vecCallee, unsigned uNum) {
+    auto start = std::chrono::steady_clock::now();
+    W WorkList;
+    long lSum = 0;
+    for (unsigned uRound = 0; uRound < 4; ++uRound) {
+        for (unsigned i = 0; i < uNum; ++i) {
+            WorkList.push(&vecCallee[(i * 7919u) % uNum]);
+        }
+    }
+    while (auto next = WorkList.pop()) {
+        lSum += **next;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() + lSum * 0;
+}
+
+int main() {
+    printf("callees    old        new\n");
+    for (unsigned uNum : {1000u, 10000u, 50000u}) {
+        std::vector<int> vecCallee(uNum);
+        double dOld = run<OldOrdWorkList<int *>>(vecCallee, uNum);
+        double dNew = run<OrdWorkList<int *>>(vecCallee, uNum);
+        printf("%-10u %.4fs    %.4fs\n", uNum, dOld, dNew);
+    }
+    return 0;
+}